@@ -0,0 +1,943 @@
+// Inventory core benchmark suite.
+//
+// Measures throughput and per-operation latency of the Storage operations
+// over grid sizes from 5x10 to 1000x1000, for a unique-id workload (every
+// add takes a new slot) and a stacking-heavy workload (32 ids, almost every
+// add merges into a stack). The footprint suite fills grids with multi-cell
+// items through first-fit search, the stacks suite adds and removes units of
+// stack-limited items, the fixed suite compares Storage with FixedStorage
+// on entity-sized grids, and the save suite measures what a save costs the
+// thread that owns the storage, synchronous or through a freeze and the
+// background writer. The nested suite works on the innermost storages of
+// bag hierarchies (deep chains and one wide level) and compares the running
+// root weight with summing the hierarchy. The catalog suite builds a 200k
+// definition catalog from parsed strings and from a catalog file. Results
+// are printed as JSON (default) or CSV.
+//
+//   inventory_bench [--quick] [--csv] [--filter <suite>]
+//
+// Throughput comes from an untimed run of each phase, latency percentiles
+// from a second run that reads the clock around every operation (so they
+// include the cost of one clock read).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "concurrent_storage.h"
+#include "fixed_storage.h"
+#include "snapshot.h"
+#include "storage.h"
+
+using namespace Inventory;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Grid
+    {
+        int rows;
+        int cols;
+    };
+
+    struct Result
+    {
+        std::string suite;
+        std::string impl;
+        std::string workload;
+        std::string op;
+        Grid        grid        {0, 0};
+        int         threads     {1};
+        size_t      ops         {0};
+        double      opsPerSec   {0};
+        double      p50         {0};
+        double      p90         {0};
+        double      p99         {0};
+        double      max         {0};
+    };
+
+    struct Options
+    {
+        bool        quick   {false};
+        bool        csv     {false};
+        std::string filter;
+    };
+
+    std::vector<Result> results;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void percentiles(std::vector<double>& samples, Result& result)
+    {
+        if (samples.empty()) {
+            return;
+        }
+
+        auto at = [&samples](double q)
+        {
+            size_t index = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+            std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+            return samples[index];
+        };
+
+        result.p50 = at(0.50);
+        result.p90 = at(0.90);
+        result.p99 = at(0.99);
+        result.max = *std::max_element(samples.begin(), samples.end());
+    }
+
+    // Runs `count` operations twice on fresh state from `setup`: once untimed
+    // for throughput and once with a clock read around every operation
+    template <typename State>
+    void measure(Result result, size_t count,
+                 const std::function<std::unique_ptr<State>()>& setup,
+                 const std::function<void(State&, size_t)>& op)
+    {
+        auto state = setup();
+        auto start = Clock::now();
+        for (size_t i = 0; i < count; i++) {
+            op(*state, i);
+        }
+        double seconds = secondsSince(start);
+
+        state = setup();
+        std::vector<double> samples(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            auto begin = Clock::now();
+            op(*state, i);
+            samples[i] = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+        }
+
+        result.ops         = count;
+        result.opsPerSec   = seconds > 0 ? count / seconds : 0;
+        percentiles(samples, result);
+        results.push_back(result);
+    }
+
+    // The pre-index Storage: every lookup is a linear scan over the slots.
+    // Kept as the "before" reference for the index and column layout.
+    class LegacyStorage
+    {
+    public:
+        LegacyStorage(int rows, int cols) : items_(rows * cols) {}
+
+        void addItem(std::unique_ptr<Item> item)
+        {
+            for (auto& existing : items_)
+            {
+                if (existing && existing->canStackWith(item.get()))
+                {
+                    existing->addToStack(item->stackCount());
+                    return;
+                }
+            }
+
+            for (auto& existing : items_)
+            {
+                if (!existing)
+                {
+                    existing = std::move(item);
+                    return;
+                }
+            }
+        }
+
+        const Item* findItemById(uint32_t id) const
+        {
+            auto it = std::find_if(items_.begin(), items_.end(),
+                                   [id](const std::unique_ptr<Item>& ptr) { return ptr && ptr->id() == id; });
+            return it != items_.end() ? it->get() : nullptr;
+        }
+
+        std::unique_ptr<Item> removeItemById(uint32_t id)
+        {
+            auto it = std::find_if(items_.begin(), items_.end(),
+                                   [id](const std::unique_ptr<Item>& ptr) { return ptr && ptr->id() == id; });
+            return it != items_.end() ? std::move(*it) : nullptr;
+        }
+
+    private:
+        std::vector<std::unique_ptr<Item>> items_;
+    };
+
+    struct Workload
+    {
+        const char* name;
+        uint32_t    distinctIds;    // 0 = one id per slot
+    };
+
+    constexpr Workload Workloads[] = {
+        {"unique",      0},
+        {"stacking",    32},
+    };
+
+    const ItemDefinition* definitionFor(uint32_t id)
+    {
+        return ItemCatalog::shared().find(id);
+    }
+
+    void registerItems(size_t count)
+    {
+        auto& catalog = ItemCatalog::shared();
+        for (uint32_t id = static_cast<uint32_t>(catalog.size()); id < count; id++) {
+            catalog.add(id, "Item", "Benchmark item", 0.1f * (1 + id % 50));
+        }
+    }
+
+    void benchStorage(const Grid& grid, const Workload& workload)
+    {
+        size_t      slots   = static_cast<size_t>(grid.rows) * grid.cols;
+        uint32_t    ids     = workload.distinctIds ? workload.distinctIds : static_cast<uint32_t>(slots);
+        auto        idAt    = [ids](size_t i) { return static_cast<uint32_t>(i % ids); };
+
+        Result base;
+        base.suite      = "storage";
+        base.impl       = "storage";
+        base.workload   = workload.name;
+        base.grid       = grid;
+
+        auto empty = [&grid]() { return std::make_unique<Storage>(grid.rows, grid.cols); };
+        auto full = [&grid, slots, &idAt]()
+        {
+            auto storage = std::make_unique<Storage>(grid.rows, grid.cols);
+            for (size_t i = 0; i < slots; i++) {
+                storage->emplaceItem(definitionFor(idAt(i)));
+            }
+            return storage;
+        };
+
+        std::mt19937 rng(42);
+        std::vector<uint32_t> lookups(std::min<size_t>(slots, 200000));
+        for (auto& id : lookups) {
+            id = rng() % ids;
+        }
+
+        Result result = base;
+        result.op = "add";
+        measure<Storage>(result, slots, empty, [&idAt](Storage& storage, size_t i) {
+            storage.addItem(std::make_unique<Item>(definitionFor(idAt(i))));
+        });
+
+        result.op = "emplace";
+        measure<Storage>(result, slots, empty, [&idAt](Storage& storage, size_t i) {
+            storage.emplaceItem(definitionFor(idAt(i)));
+        });
+
+        result.op = "stack";
+        measure<Storage>(result, slots, full, [&idAt](Storage& storage, size_t i) {
+            storage.emplaceItem(definitionFor(idAt(i)));
+        });
+
+        result.op = "find";
+        measure<Storage>(result, lookups.size(), full, [&lookups](Storage& storage, size_t i) {
+            const Item* volatile item = storage.findItemById(lookups[i]);
+            (void)item;
+        });
+
+        result.op = "remove";
+        measure<Storage>(result, slots, full, [&idAt](Storage& storage, size_t i) {
+            storage.removeFromStack(idAt(i), 1);
+        });
+
+        result.op = "batch_add";
+        size_t batches = std::max<size_t>(1, slots / 32);
+        measure<Storage>(result, batches, empty, [&idAt](Storage& storage, size_t i)
+        {
+            std::vector<ItemAmount> batch(32);
+            for (size_t j = 0; j < batch.size(); j++) {
+                batch[j] = {idAt(i * 32 + j), 1};
+            }
+            storage.addItems(batch);
+        });
+
+        result.op = "arrange";
+        measure<Storage>(result, 1, full, [](Storage& storage, size_t) {
+            storage.arrange(Storage::SortOrder::Weight);
+        });
+
+        result.op = "arrange_parallel";
+        measure<Storage>(result, 1, full, [](Storage& storage, size_t) {
+            storage.arrange(Storage::SortOrder::Weight, true);
+        });
+
+        result.op = "clear";
+        measure<Storage>(result, 1, full, [](Storage& storage, size_t) {
+            storage.clear();
+        });
+    }
+
+    // Multi-cell items get ids above the single-cell range, sizes cycle
+    // through 1x1, 3x1, 2x2 and 1x2
+    constexpr uint32_t FootprintIds = 1u << 24;
+
+    void registerFootprints(size_t count)
+    {
+        static const uint16_t sizes[][2] = {{1, 1}, {3, 1}, {2, 2}, {1, 2}};
+
+        auto& catalog = ItemCatalog::shared();
+        for (uint32_t i = 0; i < count; i++) {
+            catalog.add(FootprintIds + i, "Item", "Benchmark item", 0.1f, {}, sizes[i % 4][0], sizes[i % 4][1]);
+        }
+    }
+
+    void benchFootprint(const Grid& grid)
+    {
+        size_t slots = static_cast<size_t>(grid.rows) * grid.cols;
+
+        Result result;
+        result.suite    = "footprint";
+        result.impl     = "storage";
+        result.workload = "mixed";
+        result.grid     = grid;
+
+        // Average footprint is 2.5 cells, so this fills the grid to ~80%
+        auto empty = [&grid]() { return std::make_unique<Storage>(grid.rows, grid.cols); };
+        result.op = "place";
+        measure<Storage>(result, slots / 3, empty, [](Storage& storage, size_t i) {
+            storage.emplaceItem(definitionFor(FootprintIds + static_cast<uint32_t>(i)));
+        });
+
+        auto full = [&grid, slots]()
+        {
+            auto storage = std::make_unique<Storage>(grid.rows, grid.cols);
+            for (size_t i = 0; i < slots / 3; i++) {
+                storage->emplaceItem(definitionFor(FootprintIds + static_cast<uint32_t>(i)));
+            }
+            return storage;
+        };
+
+        result.op = "find_placement";
+        measure<Storage>(result, std::min<size_t>(slots, 100000), full, [](Storage& storage, size_t i) {
+            volatile int index = storage.findPlacement(1 + i % 3, 1 + i % 2);
+            (void)index;
+        });
+    }
+
+    // Stack-limited items (ammo-like, 60 per stack) get their own id range
+    constexpr uint32_t StackIds     = 1u << 25;
+    constexpr uint32_t StackKinds   = 64;
+    constexpr uint32_t StackLimit   = 60;
+
+    void registerStackLimited()
+    {
+        auto& catalog = ItemCatalog::shared();
+        for (uint32_t i = 0; i < StackKinds; i++) {
+            catalog.add(StackIds + i, "Ammo", "Benchmark item", 0.01f, {}, 1, 1, 0, StackLimit);
+        }
+    }
+
+    void benchStacks(const Grid& grid)
+    {
+        size_t slots = static_cast<size_t>(grid.rows) * grid.cols;
+
+        Result result;
+        result.suite    = "stacks";
+        result.impl     = "storage";
+        result.workload = "capped";
+        result.grid     = grid;
+
+        // Adds of 7 units, enough to fill ~80% of the cells with full stacks
+        size_t adds = slots * StackLimit * 4 / 5 / 7;
+        auto idAt = [](size_t i) { return StackIds + static_cast<uint32_t>(i % StackKinds); };
+
+        auto empty = [&grid]() { return std::make_unique<Storage>(grid.rows, grid.cols); };
+        result.op = "fill";
+        measure<Storage>(result, adds, empty, [&idAt](Storage& storage, size_t i) {
+            storage.emplaceItem(definitionFor(idAt(i)), 7);
+        });
+
+        auto full = [&grid, adds, &idAt]()
+        {
+            auto storage = std::make_unique<Storage>(grid.rows, grid.cols);
+            for (size_t i = 0; i < adds; i++) {
+                storage->emplaceItem(definitionFor(idAt(i)), 7);
+            }
+            return storage;
+        };
+
+        result.op = "drain";
+        measure<Storage>(result, adds, full, [&idAt](Storage& storage, size_t i) {
+            storage.removeFromStack(idAt(i), 7);
+        });
+
+        // One add spilling over ten new stacks
+        result.op = "overflow";
+        measure<Storage>(result, slots / 12, empty, [&idAt](Storage& storage, size_t i) {
+            storage.emplaceItem(definitionFor(idAt(i)), StackLimit * 10);
+        });
+    }
+
+    // Entity-sized containers, Storage against FixedStorage. construct_fill
+    // builds a container on the stack, fills it and drops it, as spawning
+    // an entity would.
+    template <typename Container, typename Build>
+    void benchFixed(const char* impl, const Grid& grid, Build build)
+    {
+        size_t  slots   = static_cast<size_t>(grid.rows) * grid.cols;
+        size_t  ops     = 100000;
+        auto    idAt    = [slots](size_t i) { return static_cast<uint32_t>(i % slots); };
+
+        Result result;
+        result.suite    = "fixed";
+        result.impl     = impl;
+        result.workload = "unique";
+        result.grid     = grid;
+
+        std::function<std::unique_ptr<Container>()> empty = [&build]() { return std::make_unique<Container>(build()); };
+        std::function<std::unique_ptr<Container>()> full = [&build, slots]()
+        {
+            auto container = std::make_unique<Container>(build());
+            for (size_t i = 0; i < slots; i++) {
+                container->emplaceItem(definitionFor(static_cast<uint32_t>(i)));
+            }
+            return container;
+        };
+
+        result.op = "construct_fill";
+        measure<Container>(result, ops / 10, empty, [&build, slots](Container&, size_t)
+        {
+            auto local = build();
+            for (size_t i = 0; i < slots; i++) {
+                local.emplaceItem(definitionFor(static_cast<uint32_t>(i)));
+            }
+        });
+
+        result.op = "find";
+        measure<Container>(result, ops, full, [&idAt](Container& container, size_t i) {
+            const Item* volatile item = container.findItemById(idAt(i * 7));
+            (void)item;
+        });
+
+        result.op = "stack";
+        measure<Container>(result, ops, full, [&idAt](Container& container, size_t i) {
+            container.emplaceItem(definitionFor(idAt(i)));
+        });
+
+        result.op = "remove_add";
+        measure<Container>(result, ops, full, [&idAt](Container& container, size_t i)
+        {
+            container.removeFromStack(idAt(i), 1);
+            container.emplaceItem(definitionFor(idAt(i)));
+        });
+    }
+
+    // Storage and the writer saving it, the writer goes first so it finishes
+    // its saves before the storage is destroyed
+    struct SaveState
+    {
+        Storage             storage;
+        AsyncSnapshotWriter writer;
+
+        explicit SaveState(const Grid& grid) : storage(grid.rows, grid.cols) {}
+    };
+
+    void benchSave(const Grid& grid)
+    {
+        size_t      slots   = static_cast<size_t>(grid.rows) * grid.cols;
+        std::string path    = (std::filesystem::temp_directory_path() / "inventory_bench.snap").string();
+        auto        idAt    = [slots](size_t i) { return static_cast<uint32_t>(i * 7919 % slots); };
+
+        Result result;
+        result.suite    = "save";
+        result.impl     = "storage";
+        result.workload = "unique";
+        result.grid     = grid;
+
+        std::function<std::unique_ptr<SaveState>()> full = [&grid, slots]()
+        {
+            auto state = std::make_unique<SaveState>(grid);
+            for (size_t i = 0; i < slots; i++) {
+                state->storage.emplaceItem(definitionFor(static_cast<uint32_t>(i)));
+            }
+            return state;
+        };
+
+        // What a save on the game thread used to cost
+        result.op = "sync_save";
+        measure<SaveState>(result, 20, full, [&path](SaveState& state, size_t)
+        {
+            SnapshotWriter writer;
+            writer.add(1, state.storage);
+            writer.save(path);
+        });
+
+        result.op = "freeze";
+        measure<SaveState>(result, 1000, full, [](SaveState& state, size_t) {
+            state.storage.freeze();
+        });
+
+        // Writes with and without a background save running, a new save is
+        // started as soon as the previous one is on disk
+        result.op = "write";
+        measure<SaveState>(result, slots, full, [&idAt](SaveState& state, size_t i)
+        {
+            state.storage.removeFromStack(idAt(i));
+            state.storage.emplaceItem(definitionFor(idAt(i)));
+        });
+
+        result.op = "write_saving";
+        measure<SaveState>(result, slots, full, [&idAt, &path](SaveState& state, size_t i)
+        {
+            if (state.writer.pending() == 0) {
+                state.writer.save(path, {{1, &state.storage}});
+            }
+
+            state.storage.removeFromStack(idAt(i));
+            state.storage.emplaceItem(definitionFor(idAt(i)));
+        });
+
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    constexpr uint32_t NestedBagId  = 1u << 26;
+    constexpr float    NestedLimit  = 1000000.0f;
+
+    // A hierarchy of bags, every storage with a weight limit so that checks
+    // walk the whole chain. leaves are the innermost storages.
+    struct NestedState
+    {
+        Storage                 root;
+        std::vector<Storage*>   leaves;
+
+        NestedState(const Grid& grid) : root(grid.rows, grid.cols, NestedLimit) {}
+    };
+
+    std::unique_ptr<Storage> makeContents(const Grid& grid)
+    {
+        auto contents = std::make_unique<Storage>(grid.rows, grid.cols, NestedLimit);
+        for (uint32_t id = 0; id < 25; id++) {
+            contents->emplaceItem(definitionFor(id));
+        }
+        return contents;
+    }
+
+    Storage::Error addBag(Storage& storage, std::unique_ptr<Storage> contents)
+    {
+        return storage.addItem(std::make_unique<Item>(definitionFor(NestedBagId)), std::move(contents));
+    }
+
+    // What the weight of a hierarchy costs without running totals
+    int64_t naiveWeight(const Storage& storage)
+    {
+        int64_t weight = 0;
+        for (size_t i = 0; i < storage.slotIds().size(); i++)
+        {
+            if (storage.slotIds()[i] == Storage::NoItem) {
+                continue;
+            }
+
+            weight += Storage::toFixedWeight(storage.slotWeights()[i]) * storage.slotCounts()[i];
+            const Storage* contents = storage.getContents(static_cast<int>(i) / storage.cols(), static_cast<int>(i) % storage.cols());
+            if (contents) {
+                weight += naiveWeight(*contents);
+            }
+        }
+        return weight;
+    }
+
+    void benchNested(const char* workload, const Grid& root, size_t depth, size_t width)
+    {
+        Grid    leafGrid    = {5, 10};
+        size_t  ops         = 100000;
+
+        Result result;
+        result.suite    = "nested";
+        result.impl     = "storage";
+        result.workload = workload;
+        result.grid     = root;
+
+        // width bags in the root, each the top of a chain of depth bags
+        std::function<std::unique_ptr<NestedState>()> build = [&root, &leafGrid, depth, width]()
+        {
+            auto state = std::make_unique<NestedState>(root);
+            for (size_t i = 0; i < width; i++)
+            {
+                auto     top    = makeContents(leafGrid);
+                Storage* leaf   = top.get();
+                for (size_t level = 1; level < depth; level++)
+                {
+                    auto     contents   = makeContents(leafGrid);
+                    Storage* inner      = contents.get();
+                    addBag(*leaf, std::move(contents));
+                    leaf = inner;
+                }
+
+                addBag(state->root, std::move(top));
+                state->leaves.push_back(leaf);
+            }
+            return state;
+        };
+
+        auto leafAt = [](NestedState& state, size_t i) { return state.leaves[i % state.leaves.size()]; };
+
+        result.op = "leaf_add_remove";
+        measure<NestedState>(result, ops, build, [&leafAt](NestedState& state, size_t i)
+        {
+            Storage* leaf = leafAt(state, i * 7919);
+            uint32_t id   = 100 + static_cast<uint32_t>(i % 16);
+            leaf->emplaceItem(definitionFor(id));
+            leaf->removeFromStack(id, 1);
+        });
+
+        result.op = "leaf_can_add";
+        measure<NestedState>(result, ops, build, [&leafAt](NestedState& state, size_t i) {
+            volatile auto error = leafAt(state, i * 7919)->canAddItem(definitionFor(100), 1);
+            (void)error;
+        });
+
+        result.op = "root_weight";
+        measure<NestedState>(result, ops, build, [](NestedState& state, size_t) {
+            volatile int64_t weight = state.root.exactWeight();
+            (void)weight;
+        });
+
+        result.op = "naive_weight";
+        measure<NestedState>(result, ops / 100, build, [](NestedState& state, size_t) {
+            volatile int64_t weight = naiveWeight(state.root);
+            (void)weight;
+        });
+    }
+
+    void benchLegacy(const Grid& grid, const Workload& workload)
+    {
+        size_t      slots   = static_cast<size_t>(grid.rows) * grid.cols;
+        uint32_t    ids     = workload.distinctIds ? workload.distinctIds : static_cast<uint32_t>(slots);
+        auto        idAt    = [ids](size_t i) { return static_cast<uint32_t>(i % ids); };
+
+        Result result;
+        result.suite    = "storage";
+        result.impl     = "legacy_scan";
+        result.workload = workload.name;
+        result.grid     = grid;
+
+        auto empty = [&grid]() { return std::make_unique<LegacyStorage>(grid.rows, grid.cols); };
+        auto full = [&grid, slots, &idAt]()
+        {
+            auto storage = std::make_unique<LegacyStorage>(grid.rows, grid.cols);
+            for (size_t i = 0; i < slots; i++) {
+                storage->addItem(std::make_unique<Item>(definitionFor(idAt(i))));
+            }
+            return storage;
+        };
+
+        result.op = "add";
+        measure<LegacyStorage>(result, slots, empty, [&idAt](LegacyStorage& storage, size_t i) {
+            storage.addItem(std::make_unique<Item>(definitionFor(idAt(i))));
+        });
+
+        result.op = "find";
+        measure<LegacyStorage>(result, slots, full, [&idAt](LegacyStorage& storage, size_t i) {
+            const Item* volatile item = storage.findItemById(idAt(i * 7919));
+            (void)item;
+        });
+
+        result.op = "remove";
+        measure<LegacyStorage>(result, slots, full, [&idAt](LegacyStorage& storage, size_t i) {
+            storage.removeItemById(idAt(i));
+        });
+    }
+
+    // A catalog row as a text parser would hand it over
+    struct CatalogRow
+    {
+        uint32_t    id;
+        std::string name;
+        std::string description;
+        std::string icon;
+        float       weight;
+        uint16_t    width;
+        uint16_t    height;
+        uint8_t     category;
+        uint32_t    maxStack;
+    };
+
+    struct CatalogState
+    {
+        std::vector<CatalogRow> rows;
+        ItemCatalog             loaded;
+    };
+
+    void benchCatalog(const Options& options)
+    {
+        uint32_t    definitions = options.quick ? 20000 : 200000;
+        std::string path        = (std::filesystem::temp_directory_path() / "inventory_bench.cat").string();
+
+        Result result;
+        result.suite    = "catalog";
+        result.impl     = "catalog";
+        result.workload = options.quick ? "20k" : "200k";
+
+        std::function<std::unique_ptr<CatalogState>()> setup = [definitions, &path]()
+        {
+            auto state = std::make_unique<CatalogState>();
+            state->rows.reserve(definitions);
+            for (uint32_t i = 0; i < definitions; i++)
+            {
+                state->rows.push_back({i, "Item " + std::to_string(i),
+                                       "Description of item " + std::to_string(i) + ", shared by a lot of nothing in particular",
+                                       i % 2 ? "icon-a" : "icon-b", 0.1f * (1 + i % 50),
+                                       static_cast<uint16_t>(1 + i % 2), 1, static_cast<uint8_t>(i % 8), i % 4 ? 0u : 20u});
+            }
+
+            ItemCatalog catalog;
+            for (const auto& row : state->rows) {
+                catalog.add(row.id, row.name, row.description, row.weight, row.icon,
+                            row.width, row.height, row.category, row.maxStack);
+            }
+            catalog.save(path);
+            state->loaded.load(path);
+            return state;
+        };
+
+        result.op = "build_from_strings";
+        measure<CatalogState>(result, 5, setup, [](CatalogState& state, size_t)
+        {
+            ItemCatalog catalog;
+            for (const auto& row : state.rows) {
+                catalog.add(row.id, row.name, row.description, row.weight, row.icon,
+                            row.width, row.height, row.category, row.maxStack);
+            }
+        });
+
+        result.op = "load_file";
+        measure<CatalogState>(result, 5, setup, [&path](CatalogState&, size_t)
+        {
+            ItemCatalog catalog;
+            catalog.load(path);
+        });
+
+        result.op = "find";
+        measure<CatalogState>(result, 100000, setup, [definitions](CatalogState& state, size_t i) {
+            const ItemDefinition* volatile definition = state.loaded.find(static_cast<uint32_t>(i * 7919 % definitions));
+            (void)definition;
+        });
+
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    // Mixed 90% read / 10% write traffic from several threads against one
+    // container: ConcurrentStorage vs a Storage behind a single mutex
+    template <typename Read, typename Write>
+    double runThreads(int threads, size_t opsPerThread, Read read, Write write)
+    {
+        std::vector<std::thread> workers;
+        auto start = Clock::now();
+        for (int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([t, opsPerThread, &read, &write]()
+            {
+                std::mt19937 rng(t + 1);
+                for (size_t i = 0; i < opsPerThread; i++)
+                {
+                    uint32_t id = rng() % 256;
+                    if (rng() % 10 == 0) write(id, i);
+                    else read(id);
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        return secondsSince(start);
+    }
+
+    void benchConcurrent(const Options& options)
+    {
+        int     maxThreads      = std::max(1u, std::thread::hardware_concurrency());
+        size_t  opsPerThread    = options.quick ? 50000 : 500000;
+        Grid    grid            {32, 32};
+
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2) {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+
+        for (int threads : threadCounts)
+        {
+            Result result;
+            result.suite    = "concurrent";
+            result.workload = "read90_write10";
+            result.op       = "mixed";
+            result.grid     = grid;
+            result.threads  = threads;
+            result.ops      = opsPerThread * threads;
+
+            ConcurrentStorage shared(grid.rows, grid.cols);
+            double seconds = runThreads(threads, opsPerThread,
+                [&shared](uint32_t id) { volatile uint32_t count = shared.findItemById(id).count; (void)count; },
+                [&shared](uint32_t id, size_t i) {
+                    if (i % 2) shared.removeFromStack(id, 1);
+                    else shared.emplaceItem(definitionFor(id));
+                });
+            result.impl         = "concurrent_storage";
+            result.opsPerSec    = result.ops / seconds;
+            results.push_back(result);
+
+            Storage     storage(grid.rows, grid.cols);
+            std::mutex  mutex;
+            seconds = runThreads(threads, opsPerThread,
+                [&storage, &mutex](uint32_t id) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    const Item* volatile item = storage.findItemById(id);
+                    (void)item;
+                },
+                [&storage, &mutex](uint32_t id, size_t i) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (i % 2) storage.removeFromStack(id, 1);
+                    else storage.emplaceItem(definitionFor(id));
+                });
+            result.impl         = "storage_mutex";
+            result.opsPerSec    = result.ops / seconds;
+            results.push_back(result);
+        }
+    }
+
+    void printJson()
+    {
+        std::printf("[\n");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto& r = results[i];
+            std::printf("  {\"suite\": \"%s\", \"impl\": \"%s\", \"workload\": \"%s\", \"op\": \"%s\", "
+                        "\"rows\": %d, \"cols\": %d, \"threads\": %d, \"ops\": %zu, \"ops_per_sec\": %.0f, "
+                        "\"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+                        r.suite.c_str(), r.impl.c_str(), r.workload.c_str(), r.op.c_str(),
+                        r.grid.rows, r.grid.cols, r.threads, r.ops, r.opsPerSec,
+                        r.p50, r.p90, r.p99, r.max, i + 1 < results.size() ? "," : "");
+        }
+        std::printf("]\n");
+    }
+
+    void printCsv()
+    {
+        std::printf("suite,impl,workload,op,rows,cols,threads,ops,ops_per_sec,p50_ns,p90_ns,p99_ns,max_ns\n");
+        for (const auto& r : results)
+        {
+            std::printf("%s,%s,%s,%s,%d,%d,%d,%zu,%.0f,%.1f,%.1f,%.1f,%.1f\n",
+                        r.suite.c_str(), r.impl.c_str(), r.workload.c_str(), r.op.c_str(),
+                        r.grid.rows, r.grid.cols, r.threads, r.ops, r.opsPerSec,
+                        r.p50, r.p90, r.p99, r.max);
+        }
+    }
+
+    bool selected(const Options& options, const char* suite)
+    {
+        return options.filter.empty() || options.filter == suite;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            options.quick = true;
+        }
+        else if (std::strcmp(argv[i], "--csv") == 0) {
+            options.csv = true;
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--quick] [--csv] [--filter <suite>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Grid> grids = {{5, 10}, {32, 32}, {100, 100}, {316, 316}, {1000, 1000}};
+    if (options.quick) {
+        grids.resize(3);
+    }
+
+    registerItems(static_cast<size_t>(grids.back().rows) * grids.back().cols);
+
+    if (selected(options, "storage"))
+    {
+        for (const auto& grid : grids)
+        {
+            for (const auto& workload : Workloads)
+            {
+                benchStorage(grid, workload);
+
+                // The linear scan is quadratic over a fill, keep it to small grids
+                if (grid.rows * grid.cols <= 100 * 100) {
+                    benchLegacy(grid, workload);
+                }
+            }
+        }
+    }
+
+    if (selected(options, "footprint"))
+    {
+        registerFootprints(static_cast<size_t>(grids.back().rows) * grids.back().cols / 3);
+        for (const auto& grid : grids) {
+            benchFootprint(grid);
+        }
+    }
+
+    if (selected(options, "stacks"))
+    {
+        registerStackLimited();
+        for (const auto& grid : grids) {
+            benchStacks(grid);
+        }
+    }
+
+    if (selected(options, "fixed"))
+    {
+        benchFixed<Storage>("storage", {5, 10}, []() { return Storage(5, 10); });
+        benchFixed<FixedStorage<5, 10>>("fixed", {5, 10}, []() { return FixedStorage<5, 10>(); });
+        benchFixed<Storage>("storage", {1, 10}, []() { return Storage(1, 10); });
+        benchFixed<FixedStorage<1, 10>>("fixed", {1, 10}, []() { return FixedStorage<1, 10>(); });
+    }
+
+    if (selected(options, "save"))
+    {
+        for (const auto& grid : grids) {
+            benchSave(grid);
+        }
+    }
+
+    if (selected(options, "nested"))
+    {
+        ItemCatalog::shared().add(NestedBagId, "Bag", "Benchmark container", 0.5f);
+        benchNested("depth_1", {5, 10}, 1, 1);
+        benchNested("depth_8", {5, 10}, 8, 1);
+        benchNested("depth_64", {5, 10}, 64, 1);
+        benchNested("wide_1024", {32, 32}, 1, 1024);
+    }
+
+    if (selected(options, "catalog")) {
+        benchCatalog(options);
+    }
+
+    if (selected(options, "concurrent")) {
+        benchConcurrent(options);
+    }
+
+    if (options.csv) printCsv();
+    else printJson();
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef BITS_H
+#define BITS_H
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Inventory {
+    namespace Bits {
+        // Index of the lowest set bit, word must not be zero
+        inline int countTrailingZeros(uint64_t word)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return static_cast<int>(index);
+#else
+            return __builtin_ctzll(word);
+#endif
+        }
+
+        inline int popCount(uint64_t word)
+        {
+#if defined(_MSC_VER)
+            return static_cast<int>(__popcnt64(word));
+#else
+            return __builtin_popcountll(word);
+#endif
+        }
+
+        // Bits [0, count) set, count in [0, 64]
+        inline uint64_t lowMask(int count) {
+            return count >= 64 ? ~0ull : (1ull << count) - 1;
+        }
+
+        // Bits [begin, end) set, 0 <= begin <= end <= 64
+        inline uint64_t rangeMask(int begin, int end) {
+            return lowMask(end) & ~lowMask(begin);
+        }
+
+        // bits[i] &= bits[i + shift] across a row of words, zeros shifted in
+        inline void andShifted(uint64_t* bits, int words, int shift)
+        {
+            int wordShift   = shift / 64;
+            int bitShift    = shift % 64;
+            for (int i = 0; i < words; i++)
+            {
+                uint64_t low    = i + wordShift < words ? bits[i + wordShift] : 0;
+                uint64_t high   = i + wordShift + 1 < words ? bits[i + wordShift + 1] : 0;
+                bits[i] &= bitShift ? (low >> bitShift) | (high << (64 - bitShift)) : low;
+            }
+        }
+
+        // Start of the first run of width set bits, or -1. Runs are found by
+        // folding the row onto itself, doubling the covered length each step.
+        inline int firstRun(uint64_t* bits, int words, int width)
+        {
+            for (int covered = 1; covered < width; )
+            {
+                int shift = covered < width - covered ? covered : width - covered;
+                andShifted(bits, words, shift);
+                covered += shift;
+            }
+
+            for (int i = 0; i < words; i++)
+            {
+                if (bits[i]) {
+                    return i * 64 + countTrailingZeros(bits[i]);
+                }
+            }
+
+            return -1;
+        }
+    }
+}
+
+#endif // BITS_H
@@ -0,0 +1,455 @@
+#include "concurrent_storage.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace Inventory {
+    namespace {
+        constexpr uint32_t EmptyKey = Storage::NoItem;
+    }
+
+    ConcurrentStorage::ConcurrentStorage(int rows, int cols, float maxWeight)
+    : rows_(rows)
+    , cols_(cols)
+    , maxWeight_(maxWeight)
+    , storage_(rows, cols, maxWeight) {
+        size_t slots = static_cast<size_t>(rows_) * cols_;
+
+        slotIds_    = std::make_unique<std::atomic<uint32_t>[]>(slots);
+        slotCounts_ = std::make_unique<std::atomic<uint32_t>[]>(slots);
+        for (size_t i = 0; i < slots; i++)
+        {
+            slotIds_[i].store(EmptyKey, std::memory_order_relaxed);
+            slotCounts_[i].store(0, std::memory_order_relaxed);
+        }
+
+        // Every stored id takes at least one slot, so twice the slot count
+        // keeps the load factor at or below one half without ever growing
+        size_t capacity = 16;
+        indexShift_ = 60;
+        while (capacity < slots * 2)
+        {
+            capacity *= 2;
+            indexShift_--;
+        }
+
+        indexMask_      = capacity - 1;
+        indexKeys_      = std::make_unique<std::atomic<uint32_t>[]>(capacity);
+        indexCounts_    = std::make_unique<std::atomic<uint64_t>[]>(capacity);
+        for (size_t i = 0; i < capacity; i++)
+        {
+            indexKeys_[i].store(EmptyKey, std::memory_order_relaxed);
+            indexCounts_[i].store(0, std::memory_order_relaxed);
+        }
+
+        freeCells_.store(storage_.freeCellCount(), std::memory_order_release);
+    }
+
+    template <typename Func>
+    auto ConcurrentStorage::readOptimistic(Func&& func) const
+    {
+        for (;;)
+        {
+            uint64_t before = sequence_.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            auto result = func();
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence_.load(std::memory_order_relaxed) == before) {
+                return result;
+            }
+        }
+    }
+
+    bool ConcurrentStorage::hasItem(uint32_t id) const
+    {
+        return countOf(id) > 0;
+    }
+
+    ItemAmount ConcurrentStorage::findItemById(uint32_t id) const
+    {
+        uint64_t count = countOf(id);
+        return {id, static_cast<uint32_t>(std::min<uint64_t>(count, std::numeric_limits<uint32_t>::max()))};
+    }
+
+    uint64_t ConcurrentStorage::countOf(uint32_t id) const
+    {
+        if (id == EmptyKey) {
+            return 0;
+        }
+
+        return readOptimistic([this, id]() -> uint64_t
+        {
+            // The probe is bounded: a table observed mid-update may have no
+            // empty entry on our path, the sequence check then forces a retry
+            size_t i = indexHome(id);
+            for (size_t probes = 0; probes <= indexMask_; probes++, i = (i + 1) & indexMask_)
+            {
+                uint32_t key = indexKeys_[i].load(std::memory_order_relaxed);
+                if (key == EmptyKey) {
+                    break;
+                }
+
+                if (key == id) {
+                    return indexCounts_[i].load(std::memory_order_relaxed);
+                }
+            }
+
+            return 0;
+        });
+    }
+
+    ItemAmount ConcurrentStorage::getItem(int row, int col) const
+    {
+        if (!isValidPosition(row, col)) {
+            return {EmptyKey, 0};
+        }
+
+        int slot = row * cols_ + col;
+        return readOptimistic([this, slot]() -> ItemAmount
+        {
+            return {slotIds_[slot].load(std::memory_order_relaxed),
+                    slotCounts_[slot].load(std::memory_order_relaxed)};
+        });
+    }
+
+    bool ConcurrentStorage::isValidPosition(int row, int col) const
+    {
+        return row >= 0 && row < rows_ && col >= 0 && col < cols_;
+    }
+
+    Storage::Error ConcurrentStorage::canAddItem(const ItemDefinition *definition, uint32_t count) const
+    {
+        if (!definition || count == 0) {
+            return Error::InvalidItem;
+        }
+
+        if (maxWeight_ > 0 &&
+            exactWeight() + Storage::toFixedWeight(definition->weight) * count > Storage::toFixedWeight(maxWeight_)) {
+            return Error::NoSpace;
+        }
+
+        return Error::Success;
+    }
+
+    Storage::Error ConcurrentStorage::addItem(std::unique_ptr<Item> item)
+    {
+        if (!item || !item->definition()) {
+            return Error::InvalidItem;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch({{item->id(), item->stackCount()}});
+        auto error = storage_.addItem(std::move(item));
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::emplaceItem(uint32_t id, uint32_t count)
+    {
+        return emplaceItem(ItemCatalog::shared().find(id), count);
+    }
+
+    Storage::Error ConcurrentStorage::emplaceItem(const ItemDefinition *definition, uint32_t count)
+    {
+        if (!definition) {
+            return Error::InvalidItem;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch({{definition->id, count}});
+        auto error = storage_.emplaceItem(definition, count);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::addItems(const std::vector<ItemAmount> &items)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch(items);
+        auto error = storage_.addItems(items);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::removeItems(const std::vector<ItemAmount> &items)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch(items);
+        auto error = storage_.removeItems(items);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::removeFromStack(uint32_t id, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch({{id, count}});
+        auto error = storage_.removeFromStack(id, count);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::splitStack(int row, int col, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Item* item = storage_.getItem(row, col);
+        if (!item) {
+            return isValidPosition(row, col) ? Error::ItemNotFound : Error::InvalidPosition;
+        }
+
+        auto touched = touch({{item->id(), 0}});
+        auto error = storage_.splitStack(row, col, count);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    Storage::Error ConcurrentStorage::mergeStacks(int fromRow, int fromCol, int toRow, int toCol)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Item* item = storage_.getItem(fromRow, fromCol);
+        if (!item) {
+            return isValidPosition(fromRow, fromCol) ? Error::ItemNotFound : Error::InvalidPosition;
+        }
+
+        auto touched = touch({{item->id(), 0}});
+        auto error = storage_.mergeStacks(fromRow, fromCol, toRow, toCol);
+        if (error == Error::Success) {
+            publish(touched);
+        }
+
+        return error;
+    }
+
+    int ConcurrentStorage::getFreeCell() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return storage_.getFreeCell();
+    }
+
+    int ConcurrentStorage::isFreeCell(int row, int col) const
+    {
+        // Cells covered by a multi-cell item are not in the published slot
+        // mirror, only the occupancy bitmap knows about them
+        std::lock_guard<std::mutex> lock(mutex_);
+        return storage_.isFreeCell(row, col);
+    }
+
+    void ConcurrentStorage::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        storage_.clear();
+        publishAll();
+    }
+
+    ConcurrentStorage::Error ConcurrentStorage::arrange(Storage::SortOrder order, bool parallel)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto error = storage_.arrange(order, parallel);
+        if (error == Error::Success) {
+            publishAll();
+        }
+
+        return error;
+    }
+
+    void ConcurrentStorage::setQueryIndexes(bool enabled)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        storage_.setQueryIndexes(enabled);
+    }
+
+    std::shared_ptr<FrozenStorage> ConcurrentStorage::freeze()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return storage_.freeze();
+    }
+
+    std::unique_ptr<Item> ConcurrentStorage::removeItemById(uint32_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto touched = touch({{id, 0}});
+        auto result = storage_.removeItemById(id);
+        if (result) {
+            publish(touched);
+        }
+
+        return result;
+    }
+
+    Storage::Error ConcurrentStorage::transfer(ConcurrentStorage &from, ConcurrentStorage &to,
+                                               const std::vector<ItemAmount> &items)
+    {
+        if (&from == &to) {
+            return Error::Success;
+        }
+
+        bool fromFirst = std::less<const ConcurrentStorage*>()(&from, &to);
+        std::lock_guard<std::mutex> first(fromFirst ? from.mutex_ : to.mutex_);
+        std::lock_guard<std::mutex> second(fromFirst ? to.mutex_ : from.mutex_);
+
+        auto fromTouched    = from.touch(items);
+        auto toTouched      = to.touch(items);
+        auto error = Storage::transfer(from.storage_, to.storage_, items);
+        if (error == Error::Success)
+        {
+            from.publish(fromTouched);
+            to.publish(toTouched);
+        }
+
+        return error;
+    }
+
+    std::vector<ConcurrentStorage::Touched> ConcurrentStorage::touch(const std::vector<ItemAmount> &items) const
+    {
+        std::vector<Touched> touched;
+        touched.reserve(items.size());
+        for (const auto& amount : items)
+        {
+            touched.push_back({amount.id, -1});
+            storage_.forEachStack(amount.id, [&touched, &amount](int slot) { touched.push_back({amount.id, slot}); });
+        }
+
+        return touched;
+    }
+
+    void ConcurrentStorage::publish(const std::vector<Touched> &touched)
+    {
+        // Old stacks may be gone, new ones are found through the id
+        beginPublish();
+        for (const auto& entry : touched)
+        {
+            if (entry.slot >= 0)
+            {
+                publishSlot(entry.slot);
+                continue;
+            }
+
+            storage_.forEachStack(entry.id, [this](int slot) { publishSlot(slot); });
+
+            uint64_t count = storage_.countOf(entry.id);
+            if (count > 0) {
+                publishIndex(entry.id, count);
+            }
+            else {
+                eraseIndex(entry.id);
+            }
+        }
+        endPublish();
+    }
+
+    void ConcurrentStorage::publishAll()
+    {
+        beginPublish();
+        for (size_t i = 0; i <= indexMask_; i++) {
+            indexKeys_[i].store(EmptyKey, std::memory_order_relaxed);
+        }
+
+        for (int slot = 0; slot < rows_ * cols_; slot++)
+        {
+            publishSlot(slot);
+            if (storage_.slotIds()[slot] != EmptyKey) {
+                publishIndex(storage_.slotIds()[slot], storage_.countOf(storage_.slotIds()[slot]));
+            }
+        }
+        endPublish();
+    }
+
+    void ConcurrentStorage::beginPublish()
+    {
+        uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void ConcurrentStorage::endPublish()
+    {
+        weight_.store(storage_.exactWeight(), std::memory_order_relaxed);
+        freeCells_.store(storage_.freeCellCount(), std::memory_order_relaxed);
+
+        uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_release);
+    }
+
+    void ConcurrentStorage::publishSlot(int slot)
+    {
+        slotIds_[slot].store(storage_.slotIds()[slot], std::memory_order_relaxed);
+        slotCounts_[slot].store(storage_.slotCounts()[slot], std::memory_order_relaxed);
+    }
+
+    void ConcurrentStorage::publishIndex(uint32_t id, uint64_t count)
+    {
+        size_t i = indexHome(id);
+        for (;;)
+        {
+            uint32_t key = indexKeys_[i].load(std::memory_order_relaxed);
+            if (key == id || key == EmptyKey) {
+                break;
+            }
+            i = (i + 1) & indexMask_;
+        }
+
+        indexCounts_[i].store(count, std::memory_order_relaxed);
+        indexKeys_[i].store(id, std::memory_order_relaxed);
+    }
+
+    void ConcurrentStorage::eraseIndex(uint32_t id)
+    {
+        size_t i = indexHome(id);
+        for (;;)
+        {
+            uint32_t key = indexKeys_[i].load(std::memory_order_relaxed);
+            if (key == EmptyKey) return;
+            if (key == id) break;
+            i = (i + 1) & indexMask_;
+        }
+
+        // Backward shift deletion, same as IdMap
+        for (size_t j = (i + 1) & indexMask_; ; j = (j + 1) & indexMask_)
+        {
+            uint32_t key = indexKeys_[j].load(std::memory_order_relaxed);
+            if (key == EmptyKey) {
+                break;
+            }
+
+            size_t h = indexHome(key);
+            if (((j - h) & indexMask_) >= ((j - i) & indexMask_))
+            {
+                indexCounts_[i].store(indexCounts_[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                indexKeys_[i].store(key, std::memory_order_relaxed);
+                i = j;
+            }
+        }
+
+        indexKeys_[i].store(EmptyKey, std::memory_order_relaxed);
+    }
+
+    size_t ConcurrentStorage::indexHome(uint32_t id) const
+    {
+        return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> indexShift_);
+    }
+}
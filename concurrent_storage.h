@@ -0,0 +1,131 @@
+#ifndef CONCURRENT_STORAGE_H
+#define CONCURRENT_STORAGE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "storage.h"
+
+namespace Inventory {
+    // Storage that can be shared between threads.
+    //
+    // Writers serialize on a per-container mutex and, after each change,
+    // publish the touched slots into an atomic mirror guarded by a sequence
+    // lock. Readers never take the mutex: they read the mirror optimistically
+    // and retry if a writer was publishing at the same time. Because a stored
+    // Item may be freed by another thread at any moment, reads return value
+    // snapshots (ItemAmount, count 0 when empty) instead of pointers.
+    // countOf() returns the units of the id over all its stacks, like
+    // Storage::countOf(). findItemById() returns the same as an ItemAmount,
+    // whose count stops at UINT32_MAX.
+    class ConcurrentStorage
+    {
+    public:
+        using Error = Storage::Error;
+
+        explicit ConcurrentStorage(int rows, int cols, float maxWeight = -1.0f);
+
+        ConcurrentStorage(const ConcurrentStorage&) = delete;
+        ConcurrentStorage& operator=(const ConcurrentStorage&) = delete;
+
+        inline int      rows()              const   { return rows_; }
+        inline int      cols()              const   { return cols_; }
+        inline float    maxWeight()         const   { return maxWeight_; }
+        inline float    currentWeight()     const   { return static_cast<float>(static_cast<double>(exactWeight()) / Storage::WeightScale); }
+        inline int64_t  exactWeight()       const   { return weight_.load(std::memory_order_acquire); }
+        inline int      freeCellCount()     const   { return freeCells_.load(std::memory_order_acquire); }
+
+        // Lock-free reads
+        bool        hasItem(uint32_t id)                const;
+        uint64_t    countOf(uint32_t id)                const;
+        ItemAmount  findItemById(uint32_t id)           const;
+        ItemAmount  getItem(int row, int col)           const;    // stack anchored at the cell
+        bool        isValidPosition(int row, int col)   const;
+        Error       canAddItem(const ItemDefinition* definition, uint32_t count) const;
+
+        // Writes, serialized per container
+        Error       addItem(std::unique_ptr<Item> item);
+        Error       emplaceItem(uint32_t id, uint32_t count = 1);
+        Error       emplaceItem(const ItemDefinition* definition, uint32_t count = 1);
+        Error       addItems(const std::vector<ItemAmount>& items);
+        Error       removeItems(const std::vector<ItemAmount>& items);
+        Error       removeFromStack(uint32_t id, uint32_t count = 1);
+        Error       splitStack(int row, int col, uint32_t count);
+        Error       mergeStacks(int fromRow, int fromCol, int toRow, int toCol);
+        int         getFreeCell()                       const;
+        int         isFreeCell(int row, int col)        const;
+
+        Error       arrange(Storage::SortOrder order, bool parallel = false);
+        void        setQueryIndexes(bool enabled);
+
+        void                    clear();
+        std::unique_ptr<Item>   removeItemById(uint32_t id);
+
+        // Freezes the slots for an AsyncSnapshotWriter, writers keep going
+        std::shared_ptr<FrozenStorage>  freeze();
+
+        // Locks both containers in address order, so two threads trading in
+        // opposite directions cannot deadlock
+        static Error transfer(ConcurrentStorage& from, ConcurrentStorage& to,
+                              const std::vector<ItemAmount>& items);
+
+        // Runs func(const Storage&) while holding the writer lock, e.g. for
+        // the Storage queries
+        template <typename Func>
+        auto read(Func&& func) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return func(storage_);
+        }
+
+    private:
+        using AtomicWords   = std::unique_ptr<std::atomic<uint32_t>[]>;
+        using AtomicCounts  = std::unique_ptr<std::atomic<uint64_t>[]>;
+
+        // Stacks each id had before a write (slot -1 if none), used to
+        // publish the change
+        struct Touched
+        {
+            uint32_t    id;
+            int         slot;
+        };
+
+        template <typename Func>
+        auto readOptimistic(Func&& func) const;
+
+        std::vector<Touched> touch(const std::vector<ItemAmount>& items) const;
+        void    publish(const std::vector<Touched>& touched);
+        void    publishAll();
+        void    beginPublish();
+        void    endPublish();
+
+        void    publishSlot(int slot);
+        void    publishIndex(uint32_t id, uint64_t count);
+        void    eraseIndex(uint32_t id);
+        size_t  indexHome(uint32_t id) const;
+
+        int                     rows_;
+        int                     cols_;
+        float                   maxWeight_;
+
+        Storage                 storage_;
+        mutable std::mutex      mutex_;
+
+        // Mirror readable without the lock
+        std::atomic<uint64_t>   sequence_       {0};
+        std::atomic<int64_t>    weight_         {0};
+        std::atomic<int>        freeCells_      {0};
+        AtomicWords             slotIds_;
+        AtomicWords             slotCounts_;
+
+        // Fixed capacity id -> total count table, never rehashed so readers
+        // can probe it while a writer updates it
+        AtomicWords             indexKeys_;
+        AtomicCounts            indexCounts_;
+        size_t                  indexMask_;
+        int                     indexShift_;
+    };
+}
+
+#endif // CONCURRENT_STORAGE_H
@@ -0,0 +1,553 @@
+#ifndef FIXED_STORAGE_H
+#define FIXED_STORAGE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include "bits.h"
+#include "item.h"
+#include "storage.h"
+
+namespace Inventory {
+    // Storage with its dimensions fixed at compile time, for the small
+    // containers owned by an entity (player bag, hotbar). Stacks, slot
+    // columns and the occupancy bitmap are inline arrays and all index math
+    // is constexpr, so the container lives inside its owner and never
+    // allocates; only the Items handed in and out by pointer come from the
+    // pool. Per-id lookups scan the contiguous id column, which for a few
+    // hundred slots is cheaper than hashing.
+    //
+    // Covers the per-entity part of the Storage API with the same names and
+    // semantics: adds with stack limits and footprints, removals, split and
+    // merge, lookups and placement. Batches, queries, arrange and delta
+    // replication are left to Storage.
+    template <int Rows, int Cols>
+    class FixedStorage
+    {
+        static_assert(Rows > 0 && Cols > 0, "FixedStorage needs at least one cell");
+        static_assert(Rows * Cols <= 1024, "FixedStorage is meant for small containers, use Storage");
+
+    public:
+        using Error = Storage::Error;
+
+        static constexpr uint32_t   NoItem      = Storage::NoItem;
+        static constexpr int        Slots       = Rows * Cols;
+        static constexpr int        WordsPerRow = (Cols + 63) / 64;
+
+        explicit FixedStorage(float maxWeight = -1.0f)
+        : maxWeight_(maxWeight)
+        , maxWeightFixed_(Storage::toFixedWeight(maxWeight)) {
+            clear();
+        }
+
+        static constexpr int    rows()  { return Rows; }
+        static constexpr int    cols()  { return Cols; }
+
+        static constexpr bool isValidPosition(int row, int col) {
+            return row >= 0 && row < Rows && col >= 0 && col < Cols;
+        }
+
+        inline float    maxWeight()         const   { return maxWeight_; }
+        inline float    currentWeight()     const   { return static_cast<float>(static_cast<double>(weight_) / Storage::WeightScale); }
+        inline int64_t  exactWeight()       const   { return weight_; }
+        inline uint64_t version()           const   { return version_; }
+        inline int      freeCellCount()     const   { return freeCells_; }
+
+        inline const std::array<uint32_t, Slots>&   slotIds()       const   { return slotIds_; }
+        inline const std::array<uint32_t, Slots>&   slotCounts()    const   { return slotCounts_; }
+
+        uint64_t countOf(uint32_t id) const
+        {
+            uint64_t count = 0;
+            for (int i = 0; i < Slots; i++)
+            {
+                if (slotIds_[i] == id) {
+                    count += slotCounts_[i];
+                }
+            }
+
+            return count;
+        }
+
+        uint32_t stacksOf(uint32_t id) const {
+            return static_cast<uint32_t>(std::count(slotIds_.begin(), slotIds_.end(), id));
+        }
+
+        int findSlot(uint32_t id) const
+        {
+            auto it = std::find(slotIds_.begin(), slotIds_.end(), id);
+            return it != slotIds_.end() ? static_cast<int>(it - slotIds_.begin()) : -1;
+        }
+
+        bool hasItem(uint32_t id) const {
+            return id != NoItem && findSlot(id) >= 0;
+        }
+
+        const Item* findItemById(uint32_t id) const
+        {
+            int slot = id != NoItem ? findSlot(id) : -1;
+            return slot >= 0 ? &items_[slot] : nullptr;
+        }
+
+        const Item* getItem(int row, int col) const
+        {
+            int anchor = getAnchor(row, col);
+            return anchor >= 0 ? &items_[anchor] : nullptr;
+        }
+
+        int getAnchor(int row, int col) const {
+            return isValidPosition(row, col) ? anchors_[row * Cols + col] : -1;
+        }
+
+        int isFreeCell(int row, int col) const {
+            return isValidPosition(row, col) && !isOccupied(occupancy_, row * Cols + col) ? row * Cols + col : -1;
+        }
+
+        int getFreeCell() const
+        {
+            // Padding bits past the last column are kept set
+            for (int i = 0; i < Rows * WordsPerRow; i++)
+            {
+                if (occupancy_[i] != ~0ull) {
+                    return (i / WordsPerRow) * Cols + (i % WordsPerRow) * 64 + Bits::countTrailingZeros(~occupancy_[i]);
+                }
+            }
+
+            return -1;
+        }
+
+        int findPlacement(int width, int height) const
+        {
+            if (width == 1 && height == 1) {
+                return getFreeCell();
+            }
+
+            return width * height <= freeCells_ ? findPlacement(occupancy_, width, height) : -1;
+        }
+
+        bool isRegionFree(int row, int col, int rows, int cols) const
+        {
+            if (rows <= 0 || cols <= 0 || !isValidPosition(row, col) ||
+                !isValidPosition(row + rows - 1, col + cols - 1)) {
+                return false;
+            }
+
+            for (int y = row; y < row + rows; y++)
+            {
+                for (int x = col; x < col + cols; x++)
+                {
+                    if (isOccupied(occupancy_, y * Cols + x)) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        Error canAddItem(const Item* item) const {
+            return item ? canAddItem(item->definition(), item->stackCount()) : Error::InvalidItem;
+        }
+
+        Error canAddItem(const ItemDefinition* definition, uint32_t count) const
+        {
+            if (!definition || definition->id == NoItem || count == 0 || definition->width == 0 || definition->height == 0) {
+                return Error::InvalidItem;
+            }
+
+            if (maxWeight_ > 0 && weight_ + Storage::toFixedWeight(definition->weight) * count > maxWeightFixed_) {
+                return Error::NoSpace;
+            }
+
+            return Error::Success;
+        }
+
+        // The units are copied into an inline stack, the Item goes back to the pool
+        Error addItem(std::unique_ptr<Item> item) {
+            return item ? emplaceItem(item->definition(), item->stackCount()) : Error::InvalidItem;
+        }
+
+        Error emplaceItem(uint32_t id, uint32_t count = 1) {
+            return emplaceItem(ItemCatalog::shared().find(id), count);
+        }
+
+        Error emplaceItem(const ItemDefinition* definition, uint32_t count = 1)
+        {
+            auto error = canAddItem(definition, count);
+            if (error != Error::Success) {
+                return error;
+            }
+
+            // One scan for the room left in the stacks of the id
+            uint64_t    room        = 0;
+            int         firstOpen   = -1;
+            for (int i = 0; i < Slots; i++)
+            {
+                if (slotIds_[i] == definition->id && hasRoom(i))
+                {
+                    firstOpen   = firstOpen < 0 ? i : firstOpen;
+                    room       += definition->maxStack ? definition->maxStack - slotCounts_[i] : count;
+                }
+            }
+
+            uint32_t stacks = newStacks(definition, count, room);
+            if (stacks == 1 && room == 0)
+            {
+                // The common case, one new stack and nothing to top up
+                int index = findPlacement(definition->width, definition->height);
+                if (index < 0) {
+                    return Error::NoSpace;
+                }
+
+                placeStack(index, definition, count);
+                return Error::Success;
+            }
+
+            // Dry run of the new stacks on a copy of the bitmap, it is only a
+            // few words
+            Occupancy occupancy = occupancy_;
+            for (uint32_t i = 0; i < stacks; i++)
+            {
+                int index = findPlacement(occupancy, definition->width, definition->height);
+                if (index < 0) {
+                    return Error::NoSpace;
+                }
+
+                fillRegion(occupancy, index, definition->width, definition->height);
+            }
+
+            // Top up the stacks that still have room, then open new ones
+            for (int i = firstOpen; i >= 0 && i < Slots && count > 0; i++)
+            {
+                if (slotIds_[i] == definition->id && hasRoom(i))
+                {
+                    uint32_t units = definition->maxStack ? std::min(count, definition->maxStack - slotCounts_[i]) : count;
+                    addToSlot(i, units);
+                    count -= units;
+                }
+            }
+
+            while (count > 0)
+            {
+                uint32_t units = definition->maxStack ? std::min(count, definition->maxStack) : count;
+                placeStack(findPlacement(definition->width, definition->height), definition, units);
+                count -= units;
+            }
+
+            return Error::Success;
+        }
+
+        Error emplaceItemAt(int row, int col, const ItemDefinition* definition, uint32_t count = 1)
+        {
+            if (!isValidPosition(row, col)) {
+                return Error::InvalidPosition;
+            }
+
+            auto error = canAddItem(definition, count);
+            if (error != Error::Success) {
+                return error;
+            }
+
+            if (!isValidPosition(row + definition->height - 1, col + definition->width - 1)) {
+                return Error::InvalidPosition;
+            }
+
+            if (definition->maxStack && count > definition->maxStack) {
+                return Error::InvalidItem;
+            }
+
+            if (!isRegionFree(row, col, definition->height, definition->width)) {
+                return Error::NoSpace;
+            }
+
+            placeStack(row * Cols + col, definition, count);
+            return Error::Success;
+        }
+
+        Error splitStack(int row, int col, uint32_t count)
+        {
+            if (!isValidPosition(row, col)) {
+                return Error::InvalidPosition;
+            }
+
+            int from = anchors_[row * Cols + col];
+            if (from < 0) {
+                return Error::ItemNotFound;
+            }
+
+            if (count == 0 || count >= slotCounts_[from]) {
+                return Error::InvalidItem;
+            }
+
+            const ItemDefinition* definition = items_[from].definition();
+            int index = findPlacement(definition->width, definition->height);
+            if (index < 0) {
+                return Error::NoSpace;
+            }
+
+            removeFromSlot(from, count);
+            placeStack(index, definition, count);
+            return Error::Success;
+        }
+
+        Error mergeStacks(int fromRow, int fromCol, int toRow, int toCol)
+        {
+            if (!isValidPosition(fromRow, fromCol) || !isValidPosition(toRow, toCol)) {
+                return Error::InvalidPosition;
+            }
+
+            int from    = anchors_[fromRow * Cols + fromCol];
+            int to      = anchors_[toRow * Cols + toCol];
+            if (from < 0 || to < 0) {
+                return Error::ItemNotFound;
+            }
+
+            if (from == to || slotIds_[from] != slotIds_[to]) {
+                return Error::InvalidItem;
+            }
+
+            uint32_t maxStack   = items_[to].maxStack();
+            uint32_t room       = maxStack ? maxStack - std::min(maxStack, slotCounts_[to]) : slotCounts_[from];
+            if (room == 0) {
+                return Error::NoSpace;
+            }
+
+            uint32_t units = std::min(slotCounts_[from], room);
+            removeFromSlot(from, units);
+            addToSlot(to, units);
+            return Error::Success;
+        }
+
+        // Removes count units of the id, from its non-full stacks first
+        Error removeFromStack(uint32_t id, uint32_t count = 1)
+        {
+            uint64_t available = id != NoItem ? countOf(id) : 0;
+            if (available == 0 || available < count) {
+                return Error::ItemNotFound;
+            }
+
+            for (int pass = 0; pass < 2 && count > 0; pass++)
+            {
+                for (int i = 0; i < Slots && count > 0; i++)
+                {
+                    if (slotIds_[i] == id && (pass == 1 || hasRoom(i)))
+                    {
+                        uint32_t units = std::min(count, slotCounts_[i]);
+                        removeFromSlot(i, units);
+                        count -= units;
+                    }
+                }
+            }
+
+            return Error::Success;
+        }
+
+        std::unique_ptr<Item> removeItem(const Item* item)
+        {
+            if (!item || item < items_.data() || item >= items_.data() + Slots) {
+                return nullptr;
+            }
+
+            int slot = static_cast<int>(item - items_.data());
+            if (slotIds_[slot] == NoItem) {
+                return nullptr;
+            }
+
+            auto result = std::make_unique<Item>(item->definition(), item->stackCount());
+            clearSlot(slot);
+            return result;
+        }
+
+        // Every stack of the id goes, the units come back as one Item
+        std::unique_ptr<Item> removeItemById(uint32_t id)
+        {
+            int slot = id != NoItem ? findSlot(id) : -1;
+            if (slot < 0) {
+                return nullptr;
+            }
+
+            auto result = std::make_unique<Item>(items_[slot].definition(), 0);
+            for (int i = slot; i < Slots; i++)
+            {
+                if (slotIds_[i] == id)
+                {
+                    result->addToStack(slotCounts_[i]);
+                    clearSlot(i);
+                }
+            }
+
+            return result;
+        }
+
+        void clear()
+        {
+            items_.fill(Item());
+            slotIds_.fill(NoItem);
+            slotCounts_.fill(0);
+            anchors_.fill(-1);
+            occupancy_  = EmptyOccupancy;
+            freeCells_  = Slots;
+            weight_     = 0;
+            version_++;
+        }
+
+    private:
+        using Occupancy = std::array<uint64_t, Rows * WordsPerRow>;
+        using Anchor    = int16_t;
+
+        // One bit per cell, rows padded to whole words with the padding set
+        static constexpr Occupancy makeEmptyOccupancy()
+        {
+            Occupancy occupancy {};
+            for (int row = 0; row < Rows && Cols % 64 != 0; row++) {
+                occupancy[(row + 1) * WordsPerRow - 1] = ~((1ull << (Cols % 64)) - 1);
+            }
+
+            return occupancy;
+        }
+
+        static constexpr Occupancy EmptyOccupancy = makeEmptyOccupancy();
+
+        static constexpr bool isOccupied(const Occupancy& occupancy, int index) {
+            return (occupancy[(index / Cols) * WordsPerRow + (index % Cols) / 64] >> ((index % Cols) % 64)) & 1;
+        }
+
+        static constexpr void setOccupied(Occupancy& occupancy, int index, bool occupied)
+        {
+            uint64_t& word  = occupancy[(index / Cols) * WordsPerRow + (index % Cols) / 64];
+            uint64_t  bit   = 1ull << ((index % Cols) % 64);
+            word = occupied ? word | bit : word & ~bit;
+        }
+
+        static void fillRegion(Occupancy& occupancy, int index, int width, int height)
+        {
+            for (int y = index / Cols; y < index / Cols + height; y++)
+            {
+                for (int x = index % Cols; x < index % Cols + width; x++) {
+                    setOccupied(occupancy, y * Cols + x, true);
+                }
+            }
+        }
+
+        // First fit, same bitboard search as Storage
+        static int findPlacement(const Occupancy& occupancy, int width, int height)
+        {
+            if (width <= 0 || height <= 0 || width > Cols || height > Rows) {
+                return -1;
+            }
+
+            std::array<uint64_t, WordsPerRow> free;
+            for (int row = 0; row + height <= Rows; row++)
+            {
+                for (int i = 0; i < WordsPerRow; i++)
+                {
+                    uint64_t used = 0;
+                    for (int y = 0; y < height; y++) {
+                        used |= occupancy[(row + y) * WordsPerRow + i];
+                    }
+                    free[i] = ~used;
+                }
+
+                int col = Bits::firstRun(free.data(), WordsPerRow, width);
+                if (col >= 0) {
+                    return row * Cols + col;
+                }
+            }
+
+            return -1;
+        }
+
+        bool hasRoom(int index) const
+        {
+            uint32_t maxStack = items_[index].maxStack();
+            return maxStack == 0 || slotCounts_[index] < maxStack;
+        }
+
+        static uint32_t newStacks(const ItemDefinition* definition, uint32_t count, uint64_t room)
+        {
+            if (room >= count) {
+                return 0;
+            }
+
+            if (definition->maxStack == 0) {
+                return 1;
+            }
+
+            return static_cast<uint32_t>((count - room + definition->maxStack - 1) / definition->maxStack);
+        }
+
+        void setFootprint(int index, const ItemDefinition* definition, bool occupied)
+        {
+            for (int y = index / Cols; y < index / Cols + definition->height; y++)
+            {
+                for (int x = index % Cols; x < index % Cols + definition->width; x++)
+                {
+                    setOccupied(occupancy_, y * Cols + x, occupied);
+                    anchors_[y * Cols + x] = static_cast<Anchor>(occupied ? index : -1);
+                }
+            }
+
+            int cells = definition->width * definition->height;
+            freeCells_ += occupied ? -cells : cells;
+        }
+
+        void placeStack(int index, const ItemDefinition* definition, uint32_t count)
+        {
+            items_[index]       = Item(definition, count);
+            slotIds_[index]     = definition->id;
+            slotCounts_[index]  = count;
+            weight_            += Storage::toFixedWeight(definition->weight) * count;
+            setFootprint(index, definition, true);
+            version_++;
+        }
+
+        void addToSlot(int index, uint32_t count)
+        {
+            items_[index].addToStack(count);
+            slotCounts_[index] += count;
+            weight_            += Storage::toFixedWeight(items_[index].weight()) * count;
+            version_++;
+        }
+
+        void removeFromSlot(int index, uint32_t count)
+        {
+            if (count >= slotCounts_[index])
+            {
+                clearSlot(index);
+                return;
+            }
+
+            items_[index].removeFromStack(count);
+            slotCounts_[index] -= count;
+            weight_            -= Storage::toFixedWeight(items_[index].weight()) * count;
+            version_++;
+        }
+
+        void clearSlot(int index)
+        {
+            const ItemDefinition* definition = items_[index].definition();
+            weight_ -= Storage::toFixedWeight(definition->weight) * slotCounts_[index];
+            setFootprint(index, definition, false);
+
+            items_[index]       = Item();
+            slotIds_[index]     = NoItem;
+            slotCounts_[index]  = 0;
+            version_++;
+        }
+
+        std::array<Item, Slots>         items_;
+        std::array<uint32_t, Slots>     slotIds_;
+        std::array<uint32_t, Slots>     slotCounts_;
+        std::array<Anchor, Slots>       anchors_;
+        Occupancy                       occupancy_;
+
+        float                           maxWeight_;
+        int64_t                         maxWeightFixed_;
+        int64_t                         weight_     {0};
+        uint64_t                        version_    {0};
+        int                             freeCells_  {Slots};
+    };
+}
+
+#endif // FIXED_STORAGE_H
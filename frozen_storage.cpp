@@ -0,0 +1,93 @@
+#include "frozen_storage.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace Inventory {
+    FrozenStorage::FrozenStorage(int rows, int cols, float maxWeight, uint64_t version,
+                                 const uint32_t *ids, const uint32_t *counts)
+    : rows_(rows)
+    , cols_(cols)
+    , maxWeight_(maxWeight)
+    , version_(version)
+    , slots_(static_cast<size_t>(rows) * cols)
+    , pages_((slots_ + PageSlots - 1) / PageSlots)
+    , ids_(ids)
+    , counts_(counts)
+    , states_(new std::atomic<uint8_t>[pages_])
+    , copies_(new std::unique_ptr<uint32_t[]>[pages_])
+    , unsettled_(pages_) {
+        for (size_t i = 0; i < pages_; i++) {
+            states_[i].store(Live, std::memory_order_relaxed);
+        }
+    }
+
+    void FrozenStorage::preserveAll()
+    {
+        for (size_t i = 0; i < pages_; i++) {
+            preserve(static_cast<int>(i << PageShift));
+        }
+    }
+
+    void FrozenStorage::preservePage(size_t page)
+    {
+        auto&   state       = states_[page];
+        uint8_t expected    = Live;
+
+        if (state.compare_exchange_strong(expected, Busy, std::memory_order_acquire))
+        {
+            size_t  first   = page << PageShift;
+            size_t  count   = pageSize(page);
+
+            std::unique_ptr<uint32_t[]> copy(new uint32_t[count * 2]);
+            std::memcpy(copy.get(), ids_ + first, count * sizeof(uint32_t));
+            std::memcpy(copy.get() + count, counts_ + first, count * sizeof(uint32_t));
+            copies_[page] = std::move(copy);
+
+            state.store(Copied, std::memory_order_release);
+            unsettled_.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        // The reader is copying the page out of the live columns
+        while (state.load(std::memory_order_acquire) == Busy) {
+            std::this_thread::yield();
+        }
+    }
+
+    const uint32_t *FrozenStorage::claimPage(size_t page, uint32_t *live)
+    {
+        auto&   state       = states_[page];
+        uint8_t expected    = Live;
+
+        if (state.compare_exchange_strong(expected, Busy, std::memory_order_acquire))
+        {
+            size_t  first   = page << PageShift;
+            size_t  count   = pageSize(page);
+
+            std::memcpy(live, ids_ + first, count * sizeof(uint32_t));
+            std::memcpy(live + count, counts_ + first, count * sizeof(uint32_t));
+
+            state.store(Read, std::memory_order_release);
+            unsettled_.fetch_sub(1, std::memory_order_release);
+            return live;
+        }
+
+        // The owner is copying the page aside
+        while (state.load(std::memory_order_acquire) == Busy) {
+            std::this_thread::yield();
+        }
+
+        if (state.load(std::memory_order_relaxed) != Copied) {
+            return nullptr;
+        }
+
+        state.store(Read, std::memory_order_relaxed);
+        return copies_[page].get();
+    }
+
+    size_t FrozenStorage::pageSize(size_t page) const
+    {
+        return std::min<size_t>(PageSlots, slots_ - (page << PageShift));
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef FROZEN_STORAGE_H
+#define FROZEN_STORAGE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Inventory {
+    // Slot columns (ids and counts) of a Storage frozen at one version,
+    // produced in O(1) by Storage::freeze() and read on another thread while
+    // the Storage keeps changing.
+    //
+    // The columns are split into pages of PageSlots slots. A page that the
+    // owner is about to change for the first time since the freeze is copied
+    // aside (copy-on-write). The reader copies every other page out of the
+    // live columns itself, and an owner write to that page waits for the
+    // 8 KB copy to finish. Copies are freed as soon as they are read, so the
+    // extra memory is at most one copy of the two columns and only for the
+    // pages changed during the save.
+    //
+    // The snapshot is read once, by a single reader.
+    class FrozenStorage
+    {
+    public:
+        static constexpr int    PageShift   = 10;
+        static constexpr int    PageSlots   = 1 << PageShift;
+
+        FrozenStorage(int rows, int cols, float maxWeight, uint64_t version,
+                      const uint32_t* ids, const uint32_t* counts);
+
+        FrozenStorage(const FrozenStorage&) = delete;
+        FrozenStorage& operator=(const FrozenStorage&) = delete;
+
+        inline int      rows()      const   { return rows_; }
+        inline int      cols()      const   { return cols_; }
+        inline float    maxWeight() const   { return maxWeight_; }
+        inline uint64_t version()   const   { return version_; }
+        inline size_t   pages()     const   { return pages_; }
+
+        // Owner side, on the thread that changes the Storage. preserve() is
+        // called before a slot changes, preserveAll() before the live columns
+        // go away. Once settled() no page needs the live columns anymore.
+        inline void preserve(int index)
+        {
+            if (states_[index >> PageShift].load(std::memory_order_acquire) < Copied) {
+                preservePage(static_cast<size_t>(index) >> PageShift);
+            }
+        }
+
+        void        preserveAll();
+        inline bool settled()   const   { return unsettled_.load(std::memory_order_acquire) == 0; }
+
+        // Reader side: calls func(slot, id, count) for every slot of the page
+        // as it was at freeze time, empty slots included
+        template <typename Func>
+        void readPage(size_t page, Func&& func)
+        {
+            size_t          first   = page << PageShift;
+            size_t          count   = pageSize(page);
+            uint32_t        live[PageSlots * 2];
+            const uint32_t* copy    = claimPage(page, live);
+
+            if (copy)
+            {
+                for (size_t i = 0; i < count; i++) {
+                    func(static_cast<uint32_t>(first + i), copy[i], copy[count + i]);
+                }
+            }
+
+            copies_[page].reset();
+        }
+
+    private:
+        enum PageState : uint8_t
+        {
+            Live,       // still only in the live columns
+            Busy,       // being read (reader) or copied (owner)
+            Copied,     // copied aside, the live page may change
+            Read,       // consumed by the reader
+        };
+
+        void            preservePage(size_t page);
+        const uint32_t* claimPage(size_t page, uint32_t* live);
+        size_t          pageSize(size_t page) const;
+
+        int                                     rows_;
+        int                                     cols_;
+        float                                   maxWeight_;
+        uint64_t                                version_;
+        size_t                                  slots_;
+        size_t                                  pages_;
+        const uint32_t*                         ids_;
+        const uint32_t*                         counts_;
+        std::unique_ptr<std::atomic<uint8_t>[]> states_;
+        std::unique_ptr<std::unique_ptr<uint32_t[]>[]> copies_;    // ids then counts
+        std::atomic<size_t>                     unsettled_;
+    };
+}
+
+#endif // FROZEN_STORAGE_H
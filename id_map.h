@@ -0,0 +1,190 @@
+#ifndef ID_MAP_H
+#define ID_MAP_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Inventory {
+    // Open addressing hash map keyed by item id.
+    // Linear probing with backward shift deletion, so there are no tombstones
+    // and lookups stay short no matter how many add/remove cycles happen.
+    // EmptyKey marks free slots and can never be stored.
+    template <typename T>
+    class IdMap
+    {
+    public:
+        static constexpr uint32_t EmptyKey = 0xFFFFFFFFu;
+
+        IdMap() = default;
+
+        inline size_t   size()      const { return size_; }
+        inline bool     empty()     const { return size_ == 0; }
+        inline size_t   capacity()  const { return keys_.size(); }
+
+        T* find(uint32_t key)
+        {
+            if (size_ == 0 || key == EmptyKey) return nullptr;
+
+            for (size_t i = home(key); ; i = (i + 1) & mask_)
+            {
+                if (keys_[i] == key) return &values_[i];
+                if (keys_[i] == EmptyKey) return nullptr;
+            }
+        }
+
+        const T* find(uint32_t key) const {
+            return const_cast<IdMap*>(this)->find(key);
+        }
+
+        bool contains(uint32_t key) const {
+            return find(key) != nullptr;
+        }
+
+        // Returns the value for the key, default-constructing it if missing
+        T& operator[](uint32_t key)
+        {
+            assert(key != EmptyKey && "EmptyKey cannot be stored");
+            if ((size_ + 1) * 2 > keys_.size()) {
+                rehash(keys_.empty() ? 16 : keys_.size() * 2);
+            }
+
+            size_t i = home(key);
+            while (keys_[i] != EmptyKey)
+            {
+                if (keys_[i] == key) return values_[i];
+                i = (i + 1) & mask_;
+            }
+
+            keys_[i] = key;
+            size_++;
+            return values_[i];
+        }
+
+        void insert(uint32_t key, T value) {
+            (*this)[key] = std::move(value);
+        }
+
+        bool erase(uint32_t key)
+        {
+            if (size_ == 0 || key == EmptyKey) return false;
+
+            size_t i = home(key);
+            while (keys_[i] != key)
+            {
+                if (keys_[i] == EmptyKey) return false;
+                i = (i + 1) & mask_;
+            }
+
+            // Shift following entries of the same cluster back into the hole
+            for (size_t j = (i + 1) & mask_; keys_[j] != EmptyKey; j = (j + 1) & mask_)
+            {
+                size_t h = home(keys_[j]);
+                if (((j - h) & mask_) >= ((j - i) & mask_))
+                {
+                    keys_[i]    = keys_[j];
+                    values_[i]  = std::move(values_[j]);
+                    i = j;
+                }
+            }
+
+            keys_[i]    = EmptyKey;
+            values_[i]  = T();
+            size_--;
+            return true;
+        }
+
+        void clear()
+        {
+            if (size_ == 0) return;
+
+            for (size_t i = 0; i < keys_.size(); i++)
+            {
+                if (keys_[i] != EmptyKey) {
+                    keys_[i]    = EmptyKey;
+                    values_[i]  = T();
+                }
+            }
+            size_ = 0;
+        }
+
+        void reserve(size_t count)
+        {
+            size_t capacity = 16;
+            while (capacity < count * 2) {
+                capacity *= 2;
+            }
+
+            if (capacity > keys_.size()) {
+                rehash(capacity);
+            }
+        }
+
+        template <typename Func>
+        void forEach(Func&& func) const
+        {
+            for (size_t i = 0; i < keys_.size(); i++)
+            {
+                if (keys_[i] != EmptyKey) {
+                    func(keys_[i], values_[i]);
+                }
+            }
+        }
+
+        template <typename Func>
+        void forEach(Func&& func)
+        {
+            for (size_t i = 0; i < keys_.size(); i++)
+            {
+                if (keys_[i] != EmptyKey) {
+                    func(keys_[i], values_[i]);
+                }
+            }
+        }
+
+    private:
+        inline size_t home(uint32_t key) const {
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> shift_);
+        }
+
+        void rehash(size_t capacity)
+        {
+            std::vector<uint32_t>   oldKeys     = std::move(keys_);
+            std::vector<T>          oldValues   = std::move(values_);
+
+            keys_.assign(capacity, EmptyKey);
+            values_.clear();
+            values_.resize(capacity);
+            mask_   = capacity - 1;
+            shift_  = 64;
+            for (size_t c = capacity; c > 1; c >>= 1) {
+                shift_--;
+            }
+
+            for (size_t i = 0; i < oldKeys.size(); i++)
+            {
+                if (oldKeys[i] == EmptyKey) {
+                    continue;
+                }
+
+                size_t j = home(oldKeys[i]);
+                while (keys_[j] != EmptyKey) {
+                    j = (j + 1) & mask_;
+                }
+
+                keys_[j]    = oldKeys[i];
+                values_[j]  = std::move(oldValues[i]);
+            }
+        }
+
+        std::vector<uint32_t>   keys_;
+        std::vector<T>          values_;
+        size_t                  size_   {0};
+        size_t                  mask_   {0};
+        int                     shift_  {64};
+    };
+}
+
+#endif // ID_MAP_H
@@ -2,41 +2,45 @@
 #define ITEM_H
 
 #include <cstdint>
-#include <string>
+#include <string_view>
+#include <new>
+#include "item_catalog.h"
+#include "item_pool.h"
 
 namespace Inventory {
+    // A stack of items in a slot. Everything but the stack size lives in the
+    // shared ItemDefinition, so an instance is just a handle and a counter.
     class Item
     {
     public:
-        Item(uint32_t id = 0, const std::string& name = std::string(),
-             const std::string& description = std::string(), float weight = 0.0f)
-            : id_(id)
-            , name_(name)
-            , description_(description)
-            , weight_(weight) {}
+        explicit Item(const ItemDefinition* definition = nullptr, uint32_t stackCount = 1)
+            : definition_(definition)
+            , stackCount_(stackCount) {}
 
-        virtual ~Item() = default;
-
-        void setName(const std::string& name) {
-            name_ = name;
-        }
-
-        void setDescription(const std::string& description) {
-            description_ = description;
+        // Instances come from the shared ItemPool instead of the general heap
+        static void* operator new(size_t size) {
+            return size == sizeof(Item) ? ItemPool::shared().allocate() : ::operator new(size);
         }
 
-        void setWeight(float weight) {
-            weight_ = weight;
+        static void operator delete(void* block, size_t size) {
+            if (size == sizeof(Item)) ItemPool::shared().deallocate(block);
+            else ::operator delete(block);
         }
 
-        inline uint32_t             id()            const { return id_; }
-        inline const std::string    name()          const { return name_; }
-        inline const std::string    description()   const { return description_; }
-        inline float                weight()        const { return weight_; }
-        inline uint32_t             stackCount()    const { return stackCount_; }
+        inline const ItemDefinition*    definition()    const { return definition_; }
+        inline uint32_t                 id()            const { return definition_->id; }
+        inline std::string_view         name()          const { return definition_->name; }
+        inline std::string_view         description()   const { return definition_->description; }
+        inline std::string_view         icon()          const { return definition_->icon; }
+        inline float                    weight()        const { return definition_->weight; }
+        inline int                      width()         const { return definition_->width; }
+        inline int                      height()        const { return definition_->height; }
+        inline int                      category()      const { return definition_->category; }
+        inline uint32_t                 maxStack()      const { return definition_->maxStack; }
+        inline uint32_t                 stackCount()    const { return stackCount_; }
 
         bool canStackWith(const Item* other) const {
-            return id_ == other->id_;
+            return definition_->id == other->definition_->id;
         }
 
         void addToStack(uint32_t count = 1) {
@@ -51,12 +55,13 @@ namespace Inventory {
             stackCount_ = 0;
         }
 
-    protected:
-        std::string name_       {};
-        std::string description_{};
-        float       weight_     {0};
-        uint32_t    id_         {0};
-        uint32_t    stackCount_ {1};
+    private:
+        const ItemDefinition*   definition_ {nullptr};
+        uint32_t                stackCount_ {1};
     };
+
+    // Every stored stack is an Item and a pool block, nested storages are
+    // kept by the Storage (see Storage::getContents())
+    static_assert(sizeof(Item) <= 16, "Item must stay a definition pointer and a count");
 }
 #endif // ITEM_H
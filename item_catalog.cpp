@@ -0,0 +1,225 @@
+#include "item_catalog.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+namespace Inventory {
+    const ItemDefinition *ItemCatalog::add(uint32_t id, std::string_view name,
+                                           std::string_view description, float weight,
+                                           std::string_view icon,
+                                           uint16_t width, uint16_t height,
+                                           uint8_t category, uint32_t maxStack)
+    {
+        // The id storages use for empty slots
+        if (id == IdMap<uint32_t>::EmptyKey) {
+            return nullptr;
+        }
+
+        // Storages hold the definitions and keep totals, indexes and
+        // footprints derived from them, so an issued definition never changes
+        if (const uint32_t* index = indexById_.find(id))
+        {
+            const ItemDefinition* existing = &definitions_[*index];
+            bool same = existing->name == name && existing->description == description &&
+                        existing->icon == icon && existing->weight == weight &&
+                        existing->width == width && existing->height == height &&
+                        existing->category == category && existing->maxStack == maxStack;
+            return same ? existing : nullptr;
+        }
+
+        indexById_.insert(id, static_cast<uint32_t>(definitions_.size()));
+        ItemDefinition* definition = &definitions_.emplace_back();
+
+        definition->id          = id;
+        definition->name        = strings_.intern(name);
+        definition->description = strings_.intern(description);
+        definition->icon        = strings_.intern(icon);
+        definition->weight      = weight;
+        definition->width       = width;
+        definition->height      = height;
+        definition->category    = category;
+        definition->maxStack    = maxStack;
+        return definition;
+    }
+
+    const ItemDefinition *ItemCatalog::find(uint32_t id) const
+    {
+        const uint32_t* index = indexById_.find(id);
+        return index ? &definitions_[*index] : nullptr;
+    }
+
+    bool ItemCatalog::load(const std::string &path)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MappedFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+
+        double mapMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!load(file.data(), file.size())) {
+            return false;
+        }
+
+        file_               = std::move(file);
+        loadStats_.mapMs    = mapMs;
+        return true;
+    }
+
+    bool ItemCatalog::load(const char *data, size_t size)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if (!data || size < sizeof(CatalogFile::FileHeader)) {
+            return false;
+        }
+
+        auto header = reinterpret_cast<const CatalogFile::FileHeader*>(data);
+        if (std::memcmp(header->magic, CatalogFile::Magic, sizeof(header->magic)) != 0 ||
+            header->version != CatalogFile::Version) {
+            return false;
+        }
+
+        // The string table ends with a terminator, so every string in it is
+        // null-terminated within the file
+        size_t available = (size - sizeof(CatalogFile::FileHeader)) / sizeof(CatalogFile::DefinitionRecord);
+        if (header->definitionCount > available ||
+            header->stringsOffset < sizeof(CatalogFile::FileHeader) + header->definitionCount * sizeof(CatalogFile::DefinitionRecord) ||
+            header->stringsOffset > size || size - header->stringsOffset < header->stringsSize ||
+            header->stringsSize == 0 || data[header->stringsOffset + header->stringsSize - 1] != '\0') {
+            return false;
+        }
+
+        auto        records = reinterpret_cast<const CatalogFile::DefinitionRecord*>(data + sizeof(CatalogFile::FileHeader));
+        const char* strings = data + header->stringsOffset;
+        uint64_t    total   = header->stringsSize;
+
+        auto fits = [total](const CatalogFile::StringRef& ref) { return ref.offset < total && ref.length < total - ref.offset; };
+        for (uint32_t i = 0; i < header->definitionCount; i++)
+        {
+            if (records[i].id == IdMap<uint32_t>::EmptyKey ||
+                !fits(records[i].name) || !fits(records[i].description) || !fits(records[i].icon)) {
+                return false;
+            }
+        }
+
+        // Views are made from offset and length, the string bytes are not read
+        auto view = [strings](const CatalogFile::StringRef& ref) { return std::string_view(strings + ref.offset, ref.length); };
+
+        clear();
+        indexById_.reserve(header->definitionCount);
+        for (uint32_t i = 0; i < header->definitionCount; i++)
+        {
+            const auto&     record      = records[i];
+            ItemDefinition* definition  = nullptr;
+            if (const uint32_t* index = indexById_.find(record.id)) {
+                definition = &definitions_[*index];
+            }
+            else
+            {
+                indexById_.insert(record.id, static_cast<uint32_t>(definitions_.size()));
+                definition = &definitions_.emplace_back();
+            }
+
+            definition->id          = record.id;
+            definition->name        = view(record.name);
+            definition->description = view(record.description);
+            definition->icon        = view(record.icon);
+            definition->weight      = record.weight;
+            definition->width       = record.width;
+            definition->height      = record.height;
+            definition->category    = record.category;
+            definition->maxStack    = record.maxStack;
+        }
+
+        loadStats_.definitions  = header->definitionCount;
+        loadStats_.strings      = header->stringCount;
+        loadStats_.fileBytes    = size;
+        loadStats_.decodeMs     = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    bool ItemCatalog::save(const std::string &path) const
+    {
+        // Offset 0 holds the empty string. Names and icons go first and
+        // descriptions last, so loading and listing the catalog never
+        // touches the description pages.
+        std::string                                                     strings(1, '\0');
+        std::unordered_map<std::string_view, CatalogFile::StringRef>    refs;
+
+        auto intern = [&strings, &refs](std::string_view text)
+        {
+            if (text.empty()) {
+                return CatalogFile::StringRef {0, 0};
+            }
+
+            auto it = refs.find(text);
+            if (it != refs.end()) {
+                return it->second;
+            }
+
+            CatalogFile::StringRef ref {static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(text.size())};
+            strings.append(text);
+            strings.push_back('\0');
+            refs.emplace(text, ref);
+            return ref;
+        };
+
+        std::vector<CatalogFile::DefinitionRecord> records(definitions_.size());
+        for (size_t i = 0; i < definitions_.size(); i++)
+        {
+            const auto& definition  = definitions_[i];
+            auto&       record      = records[i];
+
+            record.id       = definition.id;
+            record.weight   = definition.weight;
+            record.name     = intern(definition.name);
+            record.icon     = intern(definition.icon);
+            record.maxStack = definition.maxStack;
+            record.width    = definition.width;
+            record.height   = definition.height;
+            record.category = definition.category;
+        }
+
+        for (size_t i = 0; i < definitions_.size(); i++) {
+            records[i].description = intern(definitions_[i].description);
+        }
+
+        if (strings.size() > UINT32_MAX) {
+            return false;
+        }
+
+        CatalogFile::FileHeader header {};
+        std::memcpy(header.magic, CatalogFile::Magic, sizeof(header.magic));
+        header.version          = CatalogFile::Version;
+        header.definitionCount  = static_cast<uint32_t>(records.size());
+        header.stringCount      = static_cast<uint32_t>(refs.size());
+        header.stringsOffset    = sizeof(header) + records.size() * sizeof(CatalogFile::DefinitionRecord);
+        header.stringsSize      = strings.size();
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()),
+                   static_cast<std::streamsize>(records.size() * sizeof(CatalogFile::DefinitionRecord)));
+        file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+        return static_cast<bool>(file);
+    }
+
+    void ItemCatalog::clear()
+    {
+        indexById_.clear();
+        definitions_.clear();
+        strings_.clear();
+        file_.close();
+        loadStats_ = {};
+    }
+
+    ItemCatalog &ItemCatalog::shared()
+    {
+        static ItemCatalog catalog;
+        return catalog;
+    }
+}
@@ -0,0 +1,145 @@
+#ifndef ITEM_CATALOG_H
+#define ITEM_CATALOG_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include "id_map.h"
+#include "mapped_file.h"
+#include "string_pool.h"
+
+namespace Inventory {
+    // Static data shared by every instance of an item. Strings point into the
+    // catalog's string pool and are null-terminated.
+    struct ItemDefinition
+    {
+        uint32_t            id          {0};
+        std::string_view    name        {};
+        std::string_view    description {};
+        std::string_view    icon        {};
+        float               weight      {0.0f};
+
+        // Footprint in grid cells, anchored at the top-left cell
+        uint16_t            width       {1};
+        uint16_t            height      {1};
+
+        // Game-defined group (food, weapons, ...), 0 if none
+        uint8_t             category    {0};
+
+        // Most units one stack can hold, 0 for unlimited
+        uint32_t            maxStack    {0};
+    };
+
+    // Catalog file, mapped and read in place by ItemCatalog::load().
+    //
+    //   FileHeader
+    //   DefinitionRecord[definitionCount]
+    //   string table: names and icons, then descriptions, every distinct
+    //                 string stored once and null-terminated
+    //
+    // Strings are referenced by offset and length, so a definition can point
+    // at its description without reading it. Descriptions sit at the end of
+    // the file and are only paged in when shown. All fields are
+    // little-endian, fixed width and naturally aligned.
+    namespace CatalogFile {
+        constexpr char      Magic[4]    = {'I', 'N', 'V', 'C'};
+        constexpr uint16_t  Version     = 1;
+
+        struct FileHeader
+        {
+            char        magic[4];
+            uint16_t    version;
+            uint16_t    reserved;
+            uint32_t    definitionCount;
+            uint32_t    stringCount;
+            uint64_t    stringsOffset;
+            uint64_t    stringsSize;
+        };
+
+        struct StringRef
+        {
+            uint32_t    offset;
+            uint32_t    length;
+        };
+
+        struct DefinitionRecord
+        {
+            uint32_t    id;
+            float       weight;
+            StringRef   name;
+            StringRef   description;
+            StringRef   icon;
+            uint32_t    maxStack;
+            uint16_t    width;
+            uint16_t    height;
+            uint8_t     category;
+            uint8_t     reserved[3];
+        };
+    }
+
+    // Sizes and timings of the last ItemCatalog::load()
+    struct CatalogLoadStats
+    {
+        uint32_t    definitions {0};
+        uint32_t    strings     {0};
+        uint64_t    fileBytes   {0};
+        double      mapMs       {0.0};  // opening and mapping the file
+        double      decodeMs    {0.0};  // definitions and id index
+
+        inline double totalMs() const { return mapMs + decodeMs; }
+    };
+
+    class ItemCatalog
+    {
+    public:
+        using const_iterator = std::deque<ItemDefinition>::const_iterator;
+
+        ItemCatalog() = default;
+        ItemCatalog(const ItemCatalog&) = delete;
+        ItemCatalog& operator=(const ItemCatalog&) = delete;
+
+        // Adds a definition. Definitions never change once added: adding an
+        // id again returns the existing definition if every field matches
+        // and nullptr otherwise. Returned pointers stay valid until clear().
+        // Id 0xFFFFFFFF marks empty slots and is refused (nullptr).
+        const ItemDefinition* add(uint32_t id, std::string_view name,
+                                  std::string_view description = {}, float weight = 0.0f,
+                                  std::string_view icon = {},
+                                  uint16_t width = 1, uint16_t height = 1,
+                                  uint8_t category = 0, uint32_t maxStack = 0);
+
+        const ItemDefinition* find(uint32_t id) const;
+
+        // Replaces the catalog with the definitions of a catalog file. The
+        // file stays mapped until clear() and the definitions point into
+        // it, so no string is copied. On error the catalog is left as it
+        // was. The buffer overload reads a file already in memory, which
+        // must outlive the definitions.
+        bool load(const std::string& path);
+        bool load(const char* data, size_t size);
+
+        // Writes the catalog as a catalog file
+        bool save(const std::string& path) const;
+
+        inline const CatalogLoadStats& loadStats() const { return loadStats_; }
+
+        inline size_t           size()  const { return definitions_.size(); }
+        inline const_iterator   begin() const { return definitions_.begin(); }
+        inline const_iterator   end()   const { return definitions_.end(); }
+
+        void clear();
+
+        // Process-wide catalog used by the game and the demo
+        static ItemCatalog& shared();
+
+    private:
+        StringPool                  strings_;
+        std::deque<ItemDefinition>  definitions_;
+        IdMap<uint32_t>             indexById_;
+        MappedFile                  file_;
+        CatalogLoadStats            loadStats_;
+    };
+}
+
+#endif // ITEM_CATALOG_H
@@ -0,0 +1,80 @@
+#include "item_pool.h"
+#include "item.h"
+
+namespace Inventory {
+    ItemPool::ItemPool(size_t blockSize, size_t blocksPerChunk, size_t alignment)
+    : blockSize_(blockSize < sizeof(FreeBlock) ? sizeof(FreeBlock) : blockSize)
+    , blocksPerChunk_(blocksPerChunk) {
+        // Keep every block aligned for what it holds, and for the free list
+        alignment   = alignment < alignof(FreeBlock) ? alignof(FreeBlock) : alignment;
+        blockSize_  = (blockSize_ + alignment - 1) / alignment * alignment;
+    }
+
+    void *ItemPool::allocate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!freeList_) {
+            grow(blocksPerChunk_);
+        }
+
+        FreeBlock* block = freeList_;
+        freeList_ = block->next;
+        inUse_++;
+        return block;
+    }
+
+    void ItemPool::deallocate(void *block)
+    {
+        if (!block) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto freeBlock = static_cast<FreeBlock*>(block);
+        freeBlock->next = freeList_;
+        freeList_ = freeBlock;
+        inUse_--;
+    }
+
+    void ItemPool::reserve(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ - inUse_ < count) {
+            grow(count - (capacity_ - inUse_));
+        }
+    }
+
+    size_t ItemPool::capacity() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return capacity_;
+    }
+
+    size_t ItemPool::inUse() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inUse_;
+    }
+
+    void ItemPool::grow(size_t blocks)
+    {
+        chunks_.push_back(std::make_unique<char[]>(blocks * blockSize_));
+        char* chunk = chunks_.back().get();
+
+        for (size_t i = blocks; i > 0; i--)
+        {
+            auto block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * blockSize_);
+            block->next = freeList_;
+            freeList_ = block;
+        }
+
+        capacity_ += blocks;
+    }
+
+    ItemPool &ItemPool::shared()
+    {
+        // Blocks only need the alignment of an Item
+        static ItemPool* pool = new ItemPool(sizeof(Item), 4096, alignof(Item));
+        return *pool;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ITEM_POOL_H
+#define ITEM_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Inventory {
+    // Fixed-size block allocator. Blocks are carved out of large chunks and
+    // recycled through a free list, chunks are only released with the pool.
+    class ItemPool
+    {
+    public:
+        // Blocks are aligned for anything unless a smaller alignment is given
+        explicit ItemPool(size_t blockSize, size_t blocksPerChunk = 1024,
+                          size_t alignment = alignof(std::max_align_t));
+
+        ItemPool(const ItemPool&) = delete;
+        ItemPool& operator=(const ItemPool&) = delete;
+
+        void*   allocate();
+        void    deallocate(void* block);
+
+        // Makes sure at least count blocks can be handed out without growing
+        void    reserve(size_t count);
+
+        size_t  blockSize()     const { return blockSize_; }
+        size_t  capacity()      const;
+        size_t  inUse()         const;
+
+        // Pool for Item instances, never destroyed so that items owned by
+        // static objects can still be released at exit
+        static ItemPool& shared();
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        void    grow(size_t blocks);
+
+        size_t                                  blockSize_;
+        size_t                                  blocksPerChunk_;
+        size_t                                  capacity_   {0};
+        size_t                                  inUse_      {0};
+        FreeBlock*                              freeList_   {nullptr};
+        std::vector<std::unique_ptr<char[]>>    chunks_;
+        mutable std::mutex                      mutex_;
+    };
+}
+
+#endif // ITEM_POOL_H
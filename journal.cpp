@@ -0,0 +1,160 @@
+#include "journal.h"
+#include <cstring>
+#include <utility>
+
+namespace Inventory {
+    namespace {
+        void writeVarint(std::vector<uint8_t>& out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        bool readVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+        {
+            value = 0;
+            for (int shift = 0; shift < 64 && data < end; shift += 7)
+            {
+                uint8_t byte = *data++;
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool readVarint32(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+        {
+            uint64_t wide;
+            if (!readVarint(data, end, wide) || wide > 0xFFFFFFFFull) {
+                return false;
+            }
+
+            value = static_cast<uint32_t>(wide);
+            return true;
+        }
+    }
+
+    std::vector<uint8_t> StorageDelta::encode() const
+    {
+        std::vector<uint8_t> out;
+        out.reserve(16 + records.size() * 6);
+
+        writeVarint(out, fromVersion);
+        writeVarint(out, toVersion);
+        writeVarint(out, records.size());
+
+        uint32_t previousSlot = 0;
+        for (const auto& record : records)
+        {
+            out.push_back(static_cast<uint8_t>(record.op));
+            switch (record.op)
+            {
+            case DeltaOp::SlotSet:
+                writeVarint(out, record.slot - previousSlot);
+                writeVarint(out, record.id);
+                writeVarint(out, record.count);
+                previousSlot = record.slot;
+                break;
+            case DeltaOp::SlotCleared:
+                writeVarint(out, record.slot - previousSlot);
+                previousSlot = record.slot;
+                break;
+            case DeltaOp::StackCount:
+                writeVarint(out, record.slot - previousSlot);
+                writeVarint(out, record.count);
+                previousSlot = record.slot;
+                break;
+            case DeltaOp::Weight:
+            {
+                uint8_t bytes[sizeof(float)];
+                std::memcpy(bytes, &record.weight, sizeof(bytes));
+                out.insert(out.end(), bytes, bytes + sizeof(bytes));
+                break;
+            }
+            }
+        }
+
+        return out;
+    }
+
+    bool StorageDelta::decode(const uint8_t *data, size_t size, StorageDelta &result)
+    {
+        // Decoded aside, a truncated or corrupt delta leaves result untouched
+        StorageDelta    delta;
+        const uint8_t*  end     = data + size;
+
+        uint64_t count;
+        if (!readVarint(data, end, delta.fromVersion) ||
+            !readVarint(data, end, delta.toVersion) ||
+            !readVarint(data, end, count) || count > size) {
+            return false;
+        }
+
+        delta.records.reserve(static_cast<size_t>(count));
+
+        uint32_t previousSlot = 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            if (data >= end) {
+                return false;
+            }
+
+            DeltaRecord record;
+            record.op = static_cast<DeltaOp>(*data++);
+
+            uint32_t step = 0;
+            switch (record.op)
+            {
+            case DeltaOp::SlotSet:
+                if (!readVarint32(data, end, step) ||
+                    !readVarint32(data, end, record.id) ||
+                    !readVarint32(data, end, record.count)) {
+                    return false;
+                }
+                break;
+            case DeltaOp::SlotCleared:
+                if (!readVarint32(data, end, step)) {
+                    return false;
+                }
+                break;
+            case DeltaOp::StackCount:
+                if (!readVarint32(data, end, step) ||
+                    !readVarint32(data, end, record.count)) {
+                    return false;
+                }
+                break;
+            case DeltaOp::Weight:
+                if (end - data < static_cast<ptrdiff_t>(sizeof(float))) {
+                    return false;
+                }
+                std::memcpy(&record.weight, data, sizeof(float));
+                data += sizeof(float);
+                break;
+            default:
+                return false;
+            }
+
+            if (record.op != DeltaOp::Weight)
+            {
+                record.slot     = previousSlot + step;
+                previousSlot    = record.slot;
+            }
+
+            delta.records.push_back(record);
+        }
+
+        if (data != end) {
+            return false;
+        }
+
+        result = std::move(delta);
+        return true;
+    }
+}
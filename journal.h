@@ -0,0 +1,45 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Inventory {
+    enum class DeltaOp : uint8_t
+    {
+        SlotSet     = 1,    // slot now holds a new stack (id, count)
+        SlotCleared = 2,    // slot is now empty
+        StackCount  = 3,    // same item, new stack size
+        Weight      = 4,    // new weight total of the storage
+    };
+
+    struct DeltaRecord
+    {
+        DeltaOp     op      {DeltaOp::SlotCleared};
+        uint32_t    slot    {0};
+        uint32_t    id      {0};
+        uint32_t    count   {0};
+        float       weight  {0.0f};
+    };
+
+    // Changes of a Storage between two versions, produced by
+    // Storage::changesSince() and replayed with Storage::applyDelta().
+    // Slot records are ordered by slot, the weight record (if any) is last.
+    struct StorageDelta
+    {
+        uint64_t                    fromVersion {0};
+        uint64_t                    toVersion   {0};
+        std::vector<DeltaRecord>    records;
+
+        inline bool empty() const { return records.empty(); }
+
+        // Compact wire form: varint header, then one op byte per record
+        // followed by varint fields (slots are delta-coded against the
+        // previous record). Suitable for network sync or a write-ahead log.
+        std::vector<uint8_t>    encode() const;
+        static bool             decode(const uint8_t* data, size_t size, StorageDelta& delta);
+    };
+}
+
+#endif // JOURNAL_H
@@ -1,4 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -8,6 +15,7 @@
 #include "GLFW/glfw3.h"
 #include "IconsFontAwesome7.h"
 
+#include "snapshot.h"
 #include "storage.h"
 
 #define WIDTH   800
@@ -18,102 +26,300 @@
 #define INVENTORY_COLUMNS           10
 #define INVENTORY_CELL_SIZE         40
 #define INVENTORY_BORDER_COLOR      IM_COL32(200, 200, 200, 255)
+#define INVENTORY_ITEM_COLOR        IM_COL32(70, 70, 90, 255)
+#define INVENTORY_VIEW_ROWS         12
+#define INVENTORY_VIEW_COLUMNS      20
 
-float                           currentWeight = 0;
-Inventory::Storage              storage(5, 10, 100);
-std::vector<Inventory::Item>    availableItems = {
-    {1, "Water", "Bottle of water", 0.6f},
-    {2, "Gun", "Weapon", 3.5f},
-    {3, "Burger", "Food", 0.2f}
+#define TRADER_ROWS                 316
+#define TRADER_COLUMNS              316
+#define TRADER_GOODS                50000
+
+#define SAVE_FILE                   "inventories.snap"
+#define SAVE_PLAYER_KEY             1
+#define SAVE_TRADER_KEY             2
+#define CATALOG_FILE                "items.cat"
+
+#define CONTAINER_ROWS              4
+#define CONTAINER_COLUMNS           4
+#define CONTAINER_MAX_WEIGHT        30
+
+Inventory::Storage              storage(INVENTORY_ROWS, INVENTORY_COLUMNS, 100);
+Inventory::Storage              trader(TRADER_ROWS, TRADER_COLUMNS);
+
+// Defined after the storages so it finishes a running save before they go away
+Inventory::AsyncSnapshotWriter  saver;
+std::future<bool>               save_result;
+double                          save_started    = 0.0;
+std::string                     save_status;
+
+enum ItemCategory : uint8_t
+{
+    CATEGORY_NONE,
+    CATEGORY_FOOD,
+    CATEGORY_WEAPON,
+    CATEGORY_CONTAINER,
 };
-std::vector<std::string>        itemIcons = {
-    ICON_FA_BOTTLE_WATER,
-    ICON_FA_GUN,
-    ICON_FA_BURGER
+
+const char* category_names[] = {"None", "Food", "Weapon", "Container"};
+
+// A ~100k slot trader inventory with many distinct goods, to keep an eye on
+// frame time with large grids
+void fill_trader(void)
+{
+    static const char* icons[] = {ICON_FA_BOTTLE_WATER, ICON_FA_BURGER, ICON_FA_GUN, ICON_FA_SUITCASE};
+
+    auto& catalog = Inventory::ItemCatalog::shared();
+    for (uint32_t i = 0; i < TRADER_GOODS; i++)
+    {
+        uint32_t id = 1000 + i;
+        std::string name = "Trade good " + std::to_string(i);
+        const auto definition = catalog.add(id, name, "Sold by the trader", 0.1f * (1 + i % 20), icons[i % 4]);
+        trader.emplaceItem(definition, 1 + i % 5);
+    }
+}
+
+// Containers come with a storage of their own, its weight counts towards the
+// player's limit
+void append_item(const Inventory::ItemDefinition* definition)
+{
+    if (definition->category != CATEGORY_CONTAINER) {
+        storage.emplaceItem(definition);
+        return;
+    }
+
+    storage.addItem(std::make_unique<Inventory::Item>(definition),
+                    std::make_unique<Inventory::Storage>(CONTAINER_ROWS, CONTAINER_COLUMNS, CONTAINER_MAX_WEIGHT));
+}
+
+// Text and layout of one slot, rebuilt only when the slot changes
+struct CellRender
+{
+    std::string_view    icon        {};
+    ImVec2              iconSize    {};
+    ImVec2              weightSize  {};
+    char                weight[16]  {};
 };
 
-void draw_inventory(void)
+struct RenderCache
 {
-    int width   = storage.cols() * INVENTORY_CELL_SIZE;
-    int height  = storage.rows() * INVENTORY_CELL_SIZE;
+    bool                    valid   {false};
+    uint64_t                version {0};
+    std::vector<CellRender> cells;
+};
 
-    ImGui::Begin("Inventory", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+RenderCache                     storage_cache;
+RenderCache                     trader_cache;
+
+void update_render_cache(const Inventory::Storage& inventory, RenderCache& cache)
+{
+    if (cache.valid && cache.version == inventory.version()) {
+        return;
+    }
+
+    if (!cache.valid) {
+        cache.cells.assign(inventory.rows() * inventory.cols(), CellRender());
+    }
+
+    // Only the slots changed since the cached version are laid out again
+    auto delta = inventory.changesSince(cache.valid ? cache.version : 0);
+    for (const auto& record : delta.records)
     {
-        // Invisible widget so that autoresize works correctly
-        ImGui::InvisibleButton("##inventory_grid", ImVec2(width, height));
+        if (record.op == Inventory::DeltaOp::Weight) {
+            continue;
+        }
 
-        ImDrawList* drawList = ImGui::GetWindowDrawList();
-        ImVec2 cursorPos = ImGui::GetCursorScreenPos();
-        cursorPos.y -= height; // Drawing on top of an invisible widget
+        int         slot = record.slot;
+        CellRender& cell = cache.cells[slot];
+        if (inventory.slotIds()[slot] == Inventory::Storage::NoItem)
+        {
+            cell = CellRender();
+            continue;
+        }
 
-        for (int y = 0; y < storage.rows(); y++) {
-            for (int x = 0; x < storage.cols(); x++)
-            {
-                // Draw inventory cell
-                ImVec2 cellMin(cursorPos.x + x * INVENTORY_CELL_SIZE, cursorPos.y + y * INVENTORY_CELL_SIZE);
-                ImVec2 cellMax(cellMin.x + INVENTORY_CELL_SIZE, cellMin.y + INVENTORY_CELL_SIZE);
-                drawList->AddRect(cellMin, cellMax, INVENTORY_BORDER_COLOR);                
+        const auto item = inventory.getItem(slot / inventory.cols(), slot % inventory.cols());
+        cell.icon       = item->icon();
+        cell.iconSize   = ImGui::CalcTextSize(cell.icon.data(), cell.icon.data() + cell.icon.size());
+        snprintf(cell.weight, sizeof(cell.weight), "%.1f", inventory.slotWeights()[slot] * inventory.slotCounts()[slot]);
+        cell.weightSize = ImGui::CalcTextSize(cell.weight);
+    }
+
+    cache.version   = inventory.version();
+    cache.valid     = true;
+}
+
+void draw_item_tooltip(const Inventory::Item* item, const Inventory::Storage* contents)
+{
+    ImGui::BeginTooltip();
+    {
+        // Fixed popup window size
+        ImGui::PushTextWrapPos(ImGui::GetFontSize() * 20.0f);
+
+        // Title
+        ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "%.*s",
+                           (int)item->name().size(), item->name().data());
+        ImGui::Separator();
+
+        // Description
+        if (!item->description().empty()) {
+            ImGui::TextWrapped("%.*s", (int)item->description().size(), item->description().data());
+            ImGui::Spacing();
+        }
+
+        if (item->maxStack() > 0) {
+            ImGui::Text("Count: %d / %d", item->stackCount(), item->maxStack());
+        }
+        else {
+            ImGui::Text("Count: %d", item->stackCount());
+        }
+        ImGui::Text("Size: %dx%d", item->width(), item->height());
+        ImGui::Text("Weight: %.1f", item->weight());
+        ImGui::Text("Total weight: %.1f", item->weight() * item->stackCount());
+
+        if (contents) {
+            ImGui::Text("Contents: %.1f / %.1f", contents->currentWeight(), contents->maxWeight());
+        }
 
-                if (const auto item = storage.getItem(y, x))
+        ImGui::PopTextWrapPos();
+    }
+    ImGui::EndTooltip();
+}
+
+void draw_inventory(const char* title, Inventory::Storage& inventory, RenderCache& cache)
+{
+    update_render_cache(inventory, cache);
+
+    int width   = inventory.cols() * INVENTORY_CELL_SIZE;
+    int height  = inventory.rows() * INVENTORY_CELL_SIZE;
+
+    ImGui::Begin(title, nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+        // Grids bigger than the view scroll, only the visible part is drawn
+        ImVec2 viewSize(
+            (float)std::min(width, INVENTORY_VIEW_COLUMNS * INVENTORY_CELL_SIZE),
+            (float)std::min(height, INVENTORY_VIEW_ROWS * INVENTORY_CELL_SIZE)
+        );
+
+        float scrollbar = ImGui::GetStyle().ScrollbarSize;
+        if (viewSize.x < width) {
+            viewSize.y += scrollbar;
+        }
+        if (viewSize.y < height) {
+            viewSize.x += scrollbar;
+        }
+
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
+        ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 0.0f));
+        ImGui::BeginChild("##inventory_grid", viewSize, ImGuiChildFlags_None,
+                          ImGuiWindowFlags_HorizontalScrollbar);
+        {
+            ImDrawList* drawList    = ImGui::GetWindowDrawList();
+            float       scrollX     = ImGui::GetScrollX();
+            int         firstCol    = std::max(0, (int)(scrollX / INVENTORY_CELL_SIZE));
+            int         lastCol     = std::min(inventory.cols(), (int)((scrollX + ImGui::GetWindowWidth()) / INVENTORY_CELL_SIZE) + 1);
+            int         hoveredSlot = -1;
+
+            ImGuiListClipper clipper;
+            clipper.Begin(inventory.rows(), INVENTORY_CELL_SIZE);
+            while (clipper.Step())
+            {
+                int firstRow = clipper.DisplayStart;
+                for (int y = clipper.DisplayStart; y < clipper.DisplayEnd; y++)
                 {
-                    // Draw item icon
-                    int         iconIndex   = y * storage.cols() + x;
-                    const char* iconFont    = itemIcons[iconIndex].c_str();
-                    ImVec2      iconSize    = ImGui::CalcTextSize(iconFont);
-                    ImVec2      iconPos(
-                        cellMin.x + (INVENTORY_CELL_SIZE - iconSize.x) * 0.5f,
-                        cellMin.y + (INVENTORY_CELL_SIZE - iconSize.y) * 0.5f
-                    );
-
-                    drawList->AddText(iconPos, IM_COL32(255, 255, 255, 255), iconFont);
-
-                    // Draw itew weight
-                    char buffer[16];
-                    snprintf(buffer, sizeof(buffer), "%.1f", item->weight() * item->stackCount());
-
-                    std::string weightText = buffer;
-                    ImVec2      weightSize = ImGui::CalcTextSize(weightText.c_str());
-                    ImVec2      weightPos(
-                        cellMax.x - weightSize.x - 2,
-                        cellMax.y - weightSize.y - 2
-                    );
-
-                    drawList->AddText(weightPos, IM_COL32(180, 180, 180, 255), weightText.c_str());
-
-                    // Draw item popup (help message)
-                    ImVec2 mousePos = ImGui::GetMousePos();
-                    if (mousePos.x >= cellMin.x && mousePos.x <= cellMax.x &&
-                        mousePos.y >= cellMin.y && mousePos.y <= cellMax.y)
+                    ImVec2 rowPos = ImGui::GetCursorScreenPos();
+                    ImGui::Dummy(ImVec2((float)width, (float)INVENTORY_CELL_SIZE));
+
+                    for (int x = firstCol; x < lastCol; x++)
                     {
-                        ImGui::BeginTooltip();
-                        {
-                            // Fixed popup window size
-                            ImGui::PushTextWrapPos(ImGui::GetFontSize() * 20.0f);
+                        // Draw inventory cell
+                        ImVec2 cellMin(rowPos.x + x * INVENTORY_CELL_SIZE, rowPos.y);
+                        ImVec2 cellMax(cellMin.x + INVENTORY_CELL_SIZE, cellMin.y + INVENTORY_CELL_SIZE);
+                        drawList->AddRect(cellMin, cellMax, INVENTORY_BORDER_COLOR);
+
+                        int anchor = inventory.getAnchor(y, x);
+                        if (anchor < 0) {
+                            continue;
+                        }
 
-                            // Title
-                            ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "%s", item->name().c_str());
-                            ImGui::Separator();
+                        if (ImGui::IsMouseHoveringRect(cellMin, cellMax) && ImGui::IsWindowHovered()) {
+                            hoveredSlot = anchor;
+                        }
 
-                            // Description
-                            if (!item->description().empty()) {
-                                ImGui::TextWrapped("%s", item->description().c_str());
-                                ImGui::Spacing();
-                            }
+                        // Items are drawn once, from the first visible cell of
+                        // their footprint
+                        int anchorRow = anchor / inventory.cols();
+                        int anchorCol = anchor % inventory.cols();
+                        if (std::max(anchorRow, firstRow) != y || std::max(anchorCol, firstCol) != x) {
+                            continue;
+                        }
 
-                            ImGui::Text("Count: %d", item->stackCount());
-                            ImGui::Text("Weight: %.1f", item->weight());
-                            ImGui::Text("Total weight: %.1f", item->weight() * item->stackCount());
+                        const auto          item = inventory.getItem(y, x);
+                        const CellRender&   cell = cache.cells[anchor];
+                        ImVec2 itemMin(cellMin.x - (x - anchorCol) * INVENTORY_CELL_SIZE,
+                                       cellMin.y - (y - anchorRow) * INVENTORY_CELL_SIZE);
+                        ImVec2 itemMax(itemMin.x + item->width() * INVENTORY_CELL_SIZE,
+                                       itemMin.y + item->height() * INVENTORY_CELL_SIZE);
 
-                            ImGui::PopTextWrapPos();
+                        if (item->width() > 1 || item->height() > 1)
+                        {
+                            drawList->AddRectFilled(ImVec2(itemMin.x + 2, itemMin.y + 2), ImVec2(itemMax.x - 2, itemMax.y - 2),
+                                                    INVENTORY_ITEM_COLOR, 4.0f);
                         }
-                        ImGui::EndTooltip();
+
+                        // Draw item icon
+                        ImVec2 iconPos(
+                            itemMin.x + (itemMax.x - itemMin.x - cell.iconSize.x) * 0.5f,
+                            itemMin.y + (itemMax.y - itemMin.y - cell.iconSize.y) * 0.5f
+                        );
+
+                        drawList->AddText(iconPos, IM_COL32(255, 255, 255, 255), cell.icon.data(), cell.icon.data() + cell.icon.size());
+
+                        // Draw item weight
+                        ImVec2 weightPos(
+                            itemMax.x - cell.weightSize.x - 2,
+                            itemMax.y - cell.weightSize.y - 2
+                        );
+
+                        drawList->AddText(weightPos, IM_COL32(180, 180, 180, 255), cell.weight);
                     }
                 }
             }
+
+            // Draw item popup (help message), right click splits the stack in half
+            if (hoveredSlot >= 0)
+            {
+                int         row     = hoveredSlot / inventory.cols();
+                int         col     = hoveredSlot % inventory.cols();
+                const auto  item    = inventory.getItem(row, col);
+                draw_item_tooltip(item, inventory.getContents(row, col));
+
+                if (ImGui::IsMouseClicked(ImGuiMouseButton_Right) && item->stackCount() > 1) {
+                    inventory.splitStack(row, col, item->stackCount() / 2);
+                }
+            }
         }
+        ImGui::EndChild();
+        ImGui::PopStyleVar(2);
 
-        ImGui::SetCursorPosY(ImGui::GetCursorPosY());
-        ImGui::Text("Weight: %.1f / %.1f", storage.currentWeight(), storage.maxWeight());
+        if (inventory.maxWeight() > 0) {
+            ImGui::Text("Weight: %.1f / %.1f", inventory.currentWeight(), inventory.maxWeight());
+        }
+        else {
+            ImGui::Text("Weight: %.1f", inventory.currentWeight());
+        }
+
+        ImGui::TextUnformatted("Sort by");
+        ImGui::SameLine();
+        if (ImGui::Button("Id")) {
+            inventory.arrange(Inventory::Storage::SortOrder::Id);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Weight")) {
+            inventory.arrange(Inventory::Storage::SortOrder::Weight);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Name")) {
+            inventory.arrange(Inventory::Storage::SortOrder::Name);
+        }
     }
     ImGui::End();
 }
@@ -122,30 +328,56 @@ void draw_available_items(void)
 {
     ImGui::Begin("Items", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
     {
-        if (ImGui::BeginTable("ItemsTable", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        const auto& catalog = Inventory::ItemCatalog::shared();
+        const auto& stats   = catalog.loadStats();
+        ImGui::Text("%u definitions, %u strings from %s (%.1f KB) in %.2f ms",
+                    stats.definitions, stats.strings, CATALOG_FILE, stats.fileBytes / 1024.0, stats.totalMs());
+
+        // The trader goods are in the catalog too, only the visible rows are drawn
+        ImVec2 size(0.0f, ImGui::GetTextLineHeightWithSpacing() * INVENTORY_VIEW_ROWS);
+        if (ImGui::BeginTable("ItemsTable", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, size))
         {
+            ImGui::TableSetupScrollFreeze(0, 1);
             ImGui::TableSetupColumn("Item");
             ImGui::TableSetupColumn("Icon");
             ImGui::TableSetupColumn("Weight");
+            ImGui::TableSetupColumn("Size");
+            ImGui::TableSetupColumn("Owned");
             ImGui::TableSetupColumn("Action");
             ImGui::TableHeadersRow();
 
-            for (size_t i = 0; i < availableItems.size(); i++)
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(catalog.size()));
+            while (clipper.Step())
             {
-                ImGui::TableNextRow();
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                {
+                    const auto& definition = *(catalog.begin() + row);
 
-                ImGui::TableSetColumnIndex(0);
-                ImGui::Text("%s", availableItems[i].name().c_str());
+                    ImGui::TableNextRow();
+                    ImGui::PushID(row);
 
-                ImGui::TableSetColumnIndex(1);
-                ImGui::Text("%s", itemIcons[i].c_str());
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::Text("%.*s", (int)definition.name.size(), definition.name.data());
 
-                ImGui::TableSetColumnIndex(2);
-                ImGui::Text("%.1f", availableItems[i].weight());
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::Text("%.*s", (int)definition.icon.size(), definition.icon.data());
 
-                ImGui::TableSetColumnIndex(3);
-                if (ImGui::Button(("Append##" + std::to_string(i)).c_str())) {
-                    storage.addItem(std::make_unique<Inventory::Item>(availableItems[i]));
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%.1f", definition.weight);
+
+                    ImGui::TableSetColumnIndex(3);
+                    ImGui::Text("%dx%d", definition.width, definition.height);
+
+                    ImGui::TableSetColumnIndex(4);
+                    ImGui::Text("%llu", (unsigned long long)storage.countOf(definition.id));
+
+                    ImGui::TableSetColumnIndex(5);
+                    if (ImGui::Button("Append")) {
+                        append_item(&definition);
+                    }
+
+                    ImGui::PopID();
                 }
             }
 
@@ -155,8 +387,225 @@ void draw_available_items(void)
     ImGui::End();
 }
 
+void draw_query_results(const char* title, const std::vector<Inventory::SlotView>& views)
+{
+    ImGui::SeparatorText(title);
+    for (const auto& view : views)
+    {
+        ImGui::BulletText("%.*s x%u (row %d, col %d)",
+                          (int)view.item->name().size(), view.item->name().data(), view.item->stackCount(),
+                          view.slot / storage.cols(), view.slot % storage.cols());
+    }
+}
+
+void draw_item_search(void)
+{
+    static char     prefix[32]  = "";
+    static float    minWeight   = 0.0f;
+    static int      category    = CATEGORY_FOOD;
+
+    ImGui::Begin("Search", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+        ImGui::InputText("Name prefix", prefix, sizeof(prefix));
+        ImGui::SliderFloat("Min weight", &minWeight, 0.0f, 10.0f, "%.1f");
+        ImGui::Combo("Category", &category, category_names, IM_ARRAYSIZE(category_names));
+
+        draw_query_results("By name", storage.findByNamePrefix(prefix));
+        draw_query_results("By weight", storage.findByWeight(minWeight, FLT_MAX));
+        draw_query_results("By category", storage.findByCategory(static_cast<uint8_t>(category)));
+        ImGui::Text("%s total: %llu items, %.1f", category_names[category],
+                    (unsigned long long)storage.countOfCategory(static_cast<uint8_t>(category)),
+                    storage.weightOfCategory(static_cast<uint8_t>(category)));
+    }
+    ImGui::End();
+}
+
+// Bag contents are saved as storages of their own, keyed by the key of the
+// inventory and the slot of the bag
+uint64_t contents_key(uint64_t owner, int slot)
+{
+    return owner << 32 | static_cast<uint32_t>(slot);
+}
+
+std::vector<std::pair<uint64_t, Inventory::Storage*>> saved_storages(void)
+{
+    std::vector<std::pair<uint64_t, Inventory::Storage*>> storages = {{SAVE_PLAYER_KEY, &storage}, {SAVE_TRADER_KEY, &trader}};
+    for (int slot = 0; slot < storage.rows() * storage.cols(); slot++)
+    {
+        if (storage.slotIds()[slot] == Inventory::Storage::NoItem) {
+            continue;
+        }
+
+        if (Inventory::Storage* contents = storage.getContents(slot / storage.cols(), slot % storage.cols())) {
+            storages.push_back({contents_key(SAVE_PLAYER_KEY, slot), contents});
+        }
+    }
+    return storages;
+}
+
+// restore() brings the bags back without a storage, they get a new one with
+// the saved contents
+bool restore_contents(const Inventory::SnapshotShard& shard)
+{
+    for (int slot = 0; slot < storage.rows() * storage.cols(); slot++)
+    {
+        int row = slot / storage.cols();
+        int col = slot % storage.cols();
+        const Inventory::Item* item = storage.slotIds()[slot] != Inventory::Storage::NoItem ? storage.getItem(row, col) : nullptr;
+        if (!item || item->category() != CATEGORY_CONTAINER) {
+            continue;
+        }
+
+        auto contents   = std::make_unique<Inventory::Storage>(CONTAINER_ROWS, CONTAINER_COLUMNS, CONTAINER_MAX_WEIGHT);
+        auto saved      = shard.find(contents_key(SAVE_PLAYER_KEY, slot));
+        if (saved && saved.restore(*contents) != Inventory::Storage::Error::Success) {
+            return false;
+        }
+
+        if (storage.setContents(row, col, std::move(contents)) != Inventory::Storage::Error::Success) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Saving freezes the storages and leaves the encoding and the disk to the
+// saver thread, the game keeps running while the file is written
+void draw_save_game(void)
+{
+    ImGui::Begin("Save Game", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+        char text[64];
+        if (save_result.valid() && save_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            if (save_result.get()) {
+                std::snprintf(text, sizeof(text), "Saved in %.1f ms", (ImGui::GetTime() - save_started) * 1000.0);
+            }
+            else {
+                std::snprintf(text, sizeof(text), "Could not write %s", SAVE_FILE);
+            }
+            save_status = text;
+        }
+
+        bool saving = save_result.valid();
+        ImGui::BeginDisabled(saving);
+        if (ImGui::Button("Save"))
+        {
+            save_started = ImGui::GetTime();
+            save_result = saver.save(SAVE_FILE, saved_storages());
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Load"))
+        {
+            Inventory::SnapshotShard shard;
+            auto player = shard.open(std::string(SAVE_FILE)) ? shard.find(SAVE_PLAYER_KEY) : Inventory::StorageView();
+            auto goods  = player ? shard.find(SAVE_TRADER_KEY) : Inventory::StorageView();
+
+            bool loaded = goods &&
+                          player.restore(storage) == Inventory::Storage::Error::Success &&
+                          restore_contents(shard) &&
+                          goods.restore(trader) == Inventory::Storage::Error::Success;
+            save_status = loaded ? "Loaded" : "Nothing to load";
+        }
+        ImGui::EndDisabled();
+
+        ImGui::TextUnformatted(saving ? "Saving..." : save_status.c_str());
+    }
+    ImGui::End();
+}
+
+void draw_storage_profiler(void)
+{
+    ImGui::Begin("Storage Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+#if INVENTORY_STATS
+        constexpr int OpCount = static_cast<int>(Inventory::StorageOp::Count);
+
+        static uint64_t lastCalls[OpCount] = {};
+        static double   opsPerSec[OpCount] = {};
+        static double   lastSample         = 0.0;
+
+        const auto& stats = storage.stats();
+
+        // Rates are sampled twice a second so they stay readable
+        double now = ImGui::GetTime();
+        if (now - lastSample >= 0.5)
+        {
+            for (int i = 0; i < OpCount; i++)
+            {
+                opsPerSec[i] = (stats.ops[i].calls - lastCalls[i]) / (now - lastSample);
+                lastCalls[i] = stats.ops[i].calls;
+            }
+            lastSample = now;
+        }
+
+        int slots   = storage.rows() * storage.cols();
+        int used    = slots - storage.freeCellCount();
+        ImGui::Text("Slot utilization: %d / %d", used, slots);
+        ImGui::ProgressBar(slots > 0 ? (float)used / slots : 0.0f, ImVec2(-1.0f, 0.0f));
+
+        if (ImGui::BeginTable("ProfilerTable", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Operation");
+            ImGui::TableSetupColumn("Calls");
+            ImGui::TableSetupColumn("Ops/sec");
+            ImGui::TableSetupColumn("p50 (us)");
+            ImGui::TableSetupColumn("p99 (us)");
+            ImGui::TableHeadersRow();
+
+            for (int i = 0; i < OpCount; i++)
+            {
+                const auto& op = stats.ops[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%s", Inventory::StorageStats::opName(static_cast<Inventory::StorageOp>(i)));
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%llu", (unsigned long long)op.calls);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.0f", opsPerSec[i]);
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%.2f", op.latency.percentile(0.50) / 1000.0);
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("%.2f", op.latency.percentile(0.99) / 1000.0);
+            }
+
+            ImGui::EndTable();
+        }
+
+        ImGui::Text("Stack merges: %llu", (unsigned long long)stats.stackMerges);
+        ImGui::Text("New slots: %llu", (unsigned long long)stats.newSlots);
+        ImGui::Text("Rejected adds: %llu", (unsigned long long)stats.rejectedAdds);
+        ImGui::Text("Free cell searches: %llu (%.1f words scanned on average)",
+                    (unsigned long long)stats.freeCellSearches,
+                    stats.freeCellSearches ? (double)stats.freeCellWordScans / stats.freeCellSearches : 0.0);
+
+        if (ImGui::Button("Reset"))
+        {
+            storage.resetStats();
+            for (int i = 0; i < OpCount; i++) {
+                lastCalls[i] = 0;
+            }
+        }
+#else
+        ImGui::TextDisabled("Built without INVENTORY_STATS");
+#endif
+    }
+    ImGui::End();
+}
+
 int main(void)
 {
+    if (!Inventory::ItemCatalog::shared().load(CATALOG_FILE))
+    {
+        std::cerr << "Error: could not load " << CATALOG_FILE << std::endl;
+        return -1;
+    }
+
+    storage.setQueryIndexes(true);
+    fill_trader();
+
     if (!glfwInit()) {
         return -1;
     }
@@ -227,7 +676,11 @@ int main(void)
         ImGui::NewFrame();
 
         draw_available_items();
-        draw_inventory();
+        draw_inventory("Inventory", storage, storage_cache);
+        draw_inventory("Trader", trader, trader_cache);
+        draw_item_search();
+        draw_save_game();
+        draw_storage_profiler();
 
         // Rendering
         ImGui::Render();
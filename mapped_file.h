@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace Inventory {
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool    open(const std::string& path);
+        void    close();
+
+        inline const char*  data()      const { return data_; }
+        inline size_t       size()      const { return size_; }
+        inline bool         isOpen()    const { return data_ != nullptr; }
+
+    private:
+        const char* data_   {nullptr};
+        size_t      size_   {0};
+#if defined(_WIN32)
+        void*       file_   {nullptr};
+        void*       mapping_{nullptr};
+#endif
+    };
+}
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,356 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace Inventory {
+    Storage::Error StorageView::restore(Storage &storage) const
+    {
+        if (storage.rows() != rows() || storage.cols() != cols()) {
+            return Storage::Error::InvalidPosition;
+        }
+
+        const auto& catalog = ItemCatalog::shared();
+
+        storage.clear();
+        for (const auto& record : *this)
+        {
+            int row = static_cast<int>(record.slot) / cols();
+            int col = static_cast<int>(record.slot) % cols();
+
+            auto error = storage.emplaceItemAt(row, col, catalog.find(record.id), record.count);
+            if (error != Storage::Error::Success)
+            {
+                storage.clear();
+                return error;
+            }
+        }
+
+        return Storage::Error::Success;
+    }
+
+    Storage StorageView::toStorage() const
+    {
+        Storage storage(rows(), cols(), maxWeight());
+        restore(storage);
+        return storage;
+    }
+
+    SnapshotWriter::SnapshotWriter()
+    {
+        Snapshot::FileHeader header {};
+        append(header);
+    }
+
+    void SnapshotWriter::add(uint64_t key, const Storage &storage)
+    {
+        std::vector<Snapshot::SlotRecord> slots;
+        const auto& ids     = storage.slotIds();
+        const auto& counts  = storage.slotCounts();
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            if (ids[i] != Storage::NoItem) {
+                slots.push_back({static_cast<uint32_t>(i), ids[i], counts[i]});
+            }
+        }
+
+        add(key, storage.rows(), storage.cols(), storage.maxWeight(), slots);
+    }
+
+    void SnapshotWriter::add(uint64_t key, int rows, int cols, float maxWeight,
+                             const std::vector<Snapshot::SlotRecord> &slots)
+    {
+        if (finished_) {
+            return;
+        }
+
+        align();
+        index_.push_back({key, static_cast<uint64_t>(data_.size())});
+
+        Snapshot::StorageHeader header {};
+        header.rows         = rows;
+        header.cols         = cols;
+        header.maxWeight    = maxWeight;
+        header.slotCount    = static_cast<uint32_t>(slots.size());
+        append(header);
+
+        size_t offset = data_.size();
+        data_.resize(offset + slots.size() * sizeof(Snapshot::SlotRecord));
+        if (!slots.empty()) {
+            std::memcpy(&data_[offset], slots.data(), slots.size() * sizeof(Snapshot::SlotRecord));
+        }
+    }
+
+    void SnapshotWriter::add(uint64_t key, FrozenStorage &frozen)
+    {
+        if (finished_) {
+            return;
+        }
+
+        align();
+        index_.push_back({key, static_cast<uint64_t>(data_.size())});
+
+        size_t offset = data_.size();
+        Snapshot::StorageHeader header {};
+        header.rows         = frozen.rows();
+        header.cols         = frozen.cols();
+        header.maxWeight    = frozen.maxWeight();
+        append(header);
+
+        for (size_t page = 0; page < frozen.pages(); page++)
+        {
+            frozen.readPage(page, [this, &header](uint32_t slot, uint32_t id, uint32_t count)
+            {
+                if (id != Storage::NoItem)
+                {
+                    append(Snapshot::SlotRecord {slot, id, count});
+                    header.slotCount++;
+                }
+            });
+        }
+
+        std::memcpy(&data_[offset], &header, sizeof(header));
+    }
+
+    const std::vector<char> &SnapshotWriter::finish()
+    {
+        if (finished_) {
+            return data_;
+        }
+
+        std::stable_sort(index_.begin(), index_.end(),
+                         [](const Snapshot::IndexEntry& a, const Snapshot::IndexEntry& b) { return a.key < b.key; });
+
+        align();
+        Snapshot::FileHeader header {};
+        std::memcpy(header.magic, Snapshot::Magic, sizeof(header.magic));
+        header.version      = Snapshot::Version;
+        header.storageCount = static_cast<uint32_t>(index_.size());
+        header.indexOffset  = data_.size();
+
+        for (const auto& entry : index_) {
+            append(entry);
+        }
+
+        std::memcpy(data_.data(), &header, sizeof(header));
+        finished_ = true;
+        return data_;
+    }
+
+    bool SnapshotWriter::save(const std::string &path)
+    {
+        const auto& data = finish();
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+
+    AsyncSnapshotWriter::AsyncSnapshotWriter()
+    : thread_(&AsyncSnapshotWriter::run, this) {
+    }
+
+    AsyncSnapshotWriter::~AsyncSnapshotWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    std::future<bool> AsyncSnapshotWriter::save(const std::string &path,
+                                                const std::vector<std::pair<uint64_t, Storage*>> &storages)
+    {
+        std::vector<Frozen> frozen;
+        frozen.reserve(storages.size());
+        for (const auto& entry : storages) {
+            frozen.emplace_back(entry.first, entry.second->freeze());
+        }
+
+        return save(path, std::move(frozen));
+    }
+
+    std::future<bool> AsyncSnapshotWriter::save(const std::string &path, std::vector<Frozen> frozen)
+    {
+        Job job;
+        job.path    = path;
+        job.frozen  = std::move(frozen);
+        auto result = job.done.get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+
+        wake_.notify_one();
+        return result;
+    }
+
+    void AsyncSnapshotWriter::wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+    }
+
+    size_t AsyncSnapshotWriter::pending() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.size() + (busy_ ? 1 : 0);
+    }
+
+    void AsyncSnapshotWriter::run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+
+            Job job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            // Each snapshot is released once encoded, so its page copies go
+            // away before the next one is read
+            SnapshotWriter writer;
+            for (auto& entry : job.frozen)
+            {
+                writer.add(entry.first, *entry.second);
+                entry.second.reset();
+            }
+
+            std::error_code error;
+            std::string     temporary   = job.path + ".tmp";
+            bool            saved       = writer.save(temporary);
+            if (saved)
+            {
+                std::filesystem::rename(temporary, job.path, error);
+                saved = !error;
+            }
+
+            if (!saved) {
+                std::filesystem::remove(temporary, error);
+            }
+            job.done.set_value(saved);
+
+            lock.lock();
+            busy_ = false;
+            idle_.notify_all();
+        }
+    }
+
+    template <typename T>
+    void SnapshotWriter::append(const T &value)
+    {
+        size_t offset = data_.size();
+        data_.resize(offset + sizeof(T));
+        std::memcpy(&data_[offset], &value, sizeof(T));
+    }
+
+    void SnapshotWriter::align()
+    {
+        data_.resize((data_.size() + 7) & ~size_t(7), 0);
+    }
+
+    bool SnapshotShard::open(const std::string &path)
+    {
+        if (!file_.open(path)) {
+            return false;
+        }
+
+        if (!open(file_.data(), file_.size()))
+        {
+            file_.close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool SnapshotShard::open(const char *data, size_t size)
+    {
+        data_   = nullptr;
+        size_   = 0;
+        count_  = 0;
+        index_  = nullptr;
+
+        if (!data || size < sizeof(Snapshot::FileHeader)) {
+            return false;
+        }
+
+        auto header = reinterpret_cast<const Snapshot::FileHeader*>(data);
+        if (std::memcmp(header->magic, Snapshot::Magic, sizeof(header->magic)) != 0 ||
+            header->version != Snapshot::Version) {
+            return false;
+        }
+
+        if (header->indexOffset % 8 != 0 || header->indexOffset > size ||
+            (size - header->indexOffset) / sizeof(Snapshot::IndexEntry) < header->storageCount) {
+            return false;
+        }
+
+        data_   = data;
+        size_   = size;
+        count_  = header->storageCount;
+        index_  = reinterpret_cast<const Snapshot::IndexEntry*>(data + header->indexOffset);
+        return true;
+    }
+
+    uint64_t SnapshotShard::keyAt(size_t index) const
+    {
+        return index < count_ ? index_[index].key : 0;
+    }
+
+    StorageView SnapshotShard::at(size_t index) const
+    {
+        return index < count_ ? view(index_[index].offset) : StorageView();
+    }
+
+    StorageView SnapshotShard::find(uint64_t key) const
+    {
+        auto end = index_ + count_;
+        auto it = std::lower_bound(index_, end, key,
+                                   [](const Snapshot::IndexEntry& entry, uint64_t k) { return entry.key < k; });
+
+        return it != end && it->key == key ? view(it->offset) : StorageView();
+    }
+
+    StorageView SnapshotShard::view(uint64_t offset) const
+    {
+        if (offset % 8 != 0 || offset > size_ || size_ - offset < sizeof(Snapshot::StorageHeader)) {
+            return StorageView();
+        }
+
+        auto header = reinterpret_cast<const Snapshot::StorageHeader*>(data_ + offset);
+        size_t available = size_ - offset - sizeof(Snapshot::StorageHeader);
+        if (available / sizeof(Snapshot::SlotRecord) < header->slotCount) {
+            return StorageView();
+        }
+
+        // Dimensions have to make a grid a Storage can hold and every slot
+        // has to be inside it, restore() divides by cols
+        if (header->rows <= 0 || header->cols <= 0 ||
+            static_cast<int64_t>(header->rows) * header->cols > std::numeric_limits<int32_t>::max()) {
+            return StorageView();
+        }
+
+        auto        slots   = reinterpret_cast<const Snapshot::SlotRecord*>(data_ + offset + sizeof(Snapshot::StorageHeader));
+        uint32_t    cells   = static_cast<uint32_t>(header->rows * header->cols);
+        for (uint32_t i = 0; i < header->slotCount; i++)
+        {
+            if (slots[i].slot >= cells) {
+                return StorageView();
+            }
+        }
+
+        return StorageView(header, slots);
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "frozen_storage.h"
+#include "mapped_file.h"
+#include "storage.h"
+
+namespace Inventory {
+    // Binary shard of many storages, laid out so it can be read in place.
+    //
+    //   FileHeader
+    //   storage records, each 8-byte aligned:
+    //       StorageHeader, SlotRecord[slotCount]
+    //   IndexEntry[storageCount], sorted by key
+    //
+    // All fields are little-endian, fixed width and naturally aligned.
+    namespace Snapshot {
+        constexpr char      Magic[4]    = {'I', 'N', 'V', 'S'};
+        constexpr uint16_t  Version     = 1;
+
+        struct FileHeader
+        {
+            char        magic[4];
+            uint16_t    version;
+            uint16_t    reserved;
+            uint32_t    storageCount;
+            uint32_t    reserved2;
+            uint64_t    indexOffset;
+        };
+
+        struct IndexEntry
+        {
+            uint64_t    key;
+            uint64_t    offset;
+        };
+
+        struct StorageHeader
+        {
+            int32_t     rows;
+            int32_t     cols;
+            float       maxWeight;
+            uint32_t    slotCount;
+        };
+
+        // Occupied slot: row-major cell index, item id and stack size
+        struct SlotRecord
+        {
+            uint32_t    slot;
+            uint32_t    id;
+            uint32_t    count;
+        };
+    }
+
+    // Storage record read in place from a shard, no allocation involved
+    class StorageView
+    {
+    public:
+        StorageView() = default;
+        StorageView(const Snapshot::StorageHeader* header, const Snapshot::SlotRecord* slots)
+            : header_(header)
+            , slots_(slots) {}
+
+        inline explicit operator bool()                 const { return header_ != nullptr; }
+        inline int                          rows()      const { return header_->rows; }
+        inline int                          cols()      const { return header_->cols; }
+        inline float                        maxWeight() const { return header_->maxWeight; }
+        inline uint32_t                     slotCount() const { return header_->slotCount; }
+        inline const Snapshot::SlotRecord*  begin()     const { return slots_; }
+        inline const Snapshot::SlotRecord*  end()       const { return slots_ + header_->slotCount; }
+
+        // Replaces the contents of a storage with the same dimensions
+        Storage::Error  restore(Storage& storage) const;
+        Storage         toStorage() const;
+
+    private:
+        const Snapshot::StorageHeader*  header_ {nullptr};
+        const Snapshot::SlotRecord*     slots_  {nullptr};
+    };
+
+    class SnapshotWriter
+    {
+    public:
+        SnapshotWriter();
+
+        void add(uint64_t key, const Storage& storage);
+        // Reads the frozen pages straight into the shard, no slot list is built
+        void add(uint64_t key, FrozenStorage& frozen);
+        void add(uint64_t key, int rows, int cols, float maxWeight,
+                 const std::vector<Snapshot::SlotRecord>& slots);
+
+        // Appends the index and returns the finished shard
+        const std::vector<char>& finish();
+        bool save(const std::string& path);
+
+    private:
+        template <typename T>
+        void append(const T& value);
+        void align();
+
+        std::vector<char>                   data_;
+        std::vector<Snapshot::IndexEntry>   index_;
+        bool                                finished_   {false};
+    };
+
+    // Saves shards on a background thread so the game loop never waits on
+    // encoding or disk. save() freezes the storages on the calling thread,
+    // which costs about one byte per 1024 slots each, and returns. The
+    // writer then encodes the frozen pages while the storages keep changing
+    // and writes the file under a temporary name before renaming it over the
+    // target, so an interrupted save leaves the previous file intact.
+    // Saves run one at a time in submission order.
+    class AsyncSnapshotWriter
+    {
+    public:
+        using Frozen = std::pair<uint64_t, std::shared_ptr<FrozenStorage>>;
+
+        AsyncSnapshotWriter();
+        ~AsyncSnapshotWriter();     // finishes the queued saves
+
+        AsyncSnapshotWriter(const AsyncSnapshotWriter&) = delete;
+        AsyncSnapshotWriter& operator=(const AsyncSnapshotWriter&) = delete;
+
+        // The futures become true once the file is in place
+        std::future<bool>   save(const std::string& path, const std::vector<std::pair<uint64_t, Storage*>>& storages);
+        std::future<bool>   save(const std::string& path, std::vector<Frozen> frozen);
+
+        void                wait();
+        size_t              pending() const;
+
+    private:
+        struct Job
+        {
+            std::string         path;
+            std::vector<Frozen> frozen;
+            std::promise<bool>  done;
+        };
+
+        void run();
+
+        mutable std::mutex      mutex_;
+        std::condition_variable wake_;
+        std::condition_variable idle_;
+        std::deque<Job>         jobs_;
+        bool                    busy_       {false};
+        bool                    stopping_   {false};
+        std::thread             thread_;
+    };
+
+    // Shard opened through a memory mapping (or an external buffer). Opening
+    // only checks the header, storages are located with a binary search over
+    // the index and checked when accessed: records that run past the end of
+    // the shard, have no cells or more than an int can count, or hold a slot
+    // outside the grid give an empty view.
+    class SnapshotShard
+    {
+    public:
+        bool open(const std::string& path);
+        bool open(const char* data, size_t size);
+
+        inline size_t   size()  const { return count_; }
+        uint64_t        keyAt(size_t index)  const;
+        StorageView     at(size_t index)     const;
+        StorageView     find(uint64_t key)   const;
+
+    private:
+        StorageView     view(uint64_t offset) const;
+
+        MappedFile                      file_;
+        const char*                     data_   {nullptr};
+        size_t                          size_   {0};
+        size_t                          count_  {0};
+        const Snapshot::IndexEntry*     index_  {nullptr};
+    };
+}
+
+#endif // SNAPSHOT_H
@@ -1,161 +1,2031 @@
 #include "storage.h"
+#include "bits.h"
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <tuple>
 
 namespace Inventory {
+    namespace {
+        // Primary field of a sort order as an integer, so most comparisons in
+        // arrange() never have to follow the definition pointer
+        uint64_t sortKey(Storage::SortOrder order, float weight, const ItemDefinition* definition)
+        {
+            switch (order)
+            {
+            case Storage::SortOrder::Weight:
+            {
+                // Flip the float bits so they order like the values, then
+                // invert for heaviest first
+                uint32_t bits;
+                std::memcpy(&bits, &weight, sizeof(bits));
+                bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+                return ~bits;
+            }
+            case Storage::SortOrder::Name:
+            {
+                // First eight bytes, big-endian
+                uint64_t key = 0;
+                for (size_t i = 0; i < sizeof(key); i++) {
+                    key = key << 8 | (i < definition->name.size() ? static_cast<uint8_t>(definition->name[i]) : 0);
+                }
+                return key;
+            }
+            default:
+                return 0;
+            }
+        }
+
+        // Sorts in chunks on worker threads, then merges the chunks pairwise
+        template <typename Iterator, typename Compare>
+        void parallelSort(Iterator begin, Iterator end, Compare compare)
+        {
+            size_t size     = static_cast<size_t>(end - begin);
+            size_t chunks   = std::max(1u, std::thread::hardware_concurrency());
+            if (chunks == 1 || size < chunks * 4096)
+            {
+                std::sort(begin, end, compare);
+                return;
+            }
+
+            std::vector<Iterator> bounds;
+            for (size_t i = 0; i <= chunks; i++) {
+                bounds.push_back(begin + size * i / chunks);
+            }
+
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < chunks; i++) {
+                workers.emplace_back([&bounds, &compare, i]() { std::sort(bounds[i], bounds[i + 1], compare); });
+            }
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+            for (size_t step = 1; step < chunks; step *= 2)
+            {
+                workers.clear();
+                for (size_t i = 0; i + step < chunks; i += step * 2)
+                {
+                    Iterator first  = bounds[i];
+                    Iterator middle = bounds[i + step];
+                    Iterator last   = bounds[std::min(chunks, i + step * 2)];
+                    workers.emplace_back([first, middle, last, &compare]() { std::inplace_merge(first, middle, last, compare); });
+                }
+
+                for (auto& worker : workers) {
+                    worker.join();
+                }
+            }
+        }
+    }
+
     Storage::Storage(int rows, int cols, float maxWeight)
     : rows_(rows)
     , cols_(cols)
     , maxWeight_(maxWeight)
-    , currentWeight_(0.0f) {
+    , maxWeightFixed_(toFixedWeight(maxWeight))
+    , wordsPerRow_((cols + 63) / 64) {
+        weight_.node->limit = maxWeight_ > 0 ? maxWeightFixed_ : -1;
         items_.resize(rows_ * cols_);
+        slotIds_.assign(rows_ * cols_, NoItem);
+        slotCounts_.assign(rows_ * cols_, 0);
+        slotWeights_.assign(rows_ * cols_, 0.0f);
+        slotVersions_.assign(rows_ * cols_, 0);
+        slotAssignVersions_.assign(rows_ * cols_, 0);
+        blockVersions_.assign((rows_ * cols_ + 63) / 64, 0);
+        anchors_.assign(rows_ * cols_, -1);
+        stackLinks_.resize(rows_ * cols_);
+        resetOccupancy();
+    }
+
+    Storage::~Storage()
+    {
+        frozen_.release();
+    }
+
+    Storage::Storage(Storage &&other)
+    : Storage(other.rows_, other.cols_, other.maxWeight_) {
+        uint64_t version = other.version_;
+        setQueryIndexes(other.queryIndexes_);
+        swapContents(other);
+        other.touchAll(version + 1);
+    }
+
+    Storage &Storage::operator=(Storage &&other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+
+        // Our old contents end up in the temporary and go with it
+        Storage empty(other.rows_, other.cols_, other.maxWeight_);
+        empty.setQueryIndexes(other.queryIndexes_);
+
+        uint64_t ours   = version_;
+        uint64_t theirs = other.version_;
+        swapContents(other);
+        other.swapContents(empty);
+
+        touchAll(std::max(ours, theirs) + 1);
+        other.touchAll(theirs + 1);
+        return *this;
+    }
+
+    void Storage::swapContents(Storage &other)
+    {
+        // Snapshots read the live columns, which are about to change hands
+        frozen_.release();
+        other.frozen_.release();
+
+        std::swap(rows_,                other.rows_);
+        std::swap(cols_,                other.cols_);
+        std::swap(maxWeight_,           other.maxWeight_);
+        std::swap(maxWeightFixed_,      other.maxWeightFixed_);
+        std::swap(items_,               other.items_);
+        std::swap(contents_,            other.contents_);
+        weight_.swap(other.weight_);
+        std::swap(totalsById_,          other.totalsById_);
+        std::swap(totalsByCategory_,    other.totalsByCategory_);
+        std::swap(slotIds_,             other.slotIds_);
+        std::swap(slotCounts_,          other.slotCounts_);
+        std::swap(slotWeights_,         other.slotWeights_);
+        std::swap(version_,             other.version_);
+        std::swap(sourceVersion_,       other.sourceVersion_);
+        std::swap(slotVersions_,        other.slotVersions_);
+        std::swap(slotAssignVersions_,  other.slotAssignVersions_);
+        std::swap(blockVersions_,       other.blockVersions_);
+        std::swap(stacksById_,          other.stacksById_);
+        std::swap(stackLinks_,          other.stackLinks_);
+        std::swap(wordsPerRow_,         other.wordsPerRow_);
+        std::swap(freeCells_,           other.freeCells_);
+        std::swap(occupancy_,           other.occupancy_);
+        std::swap(freeWords_,           other.freeWords_);
+        std::swap(anchors_,             other.anchors_);
+        std::swap(queryIndexes_,        other.queryIndexes_);
+        std::swap(nameIndex_,           other.nameIndex_);
+        std::swap(weightIndex_,         other.weightIndex_);
+        std::swap(categorySlots_,       other.categorySlots_);
+    }
+
+    void Storage::touchAll(uint64_t version)
+    {
+        // Every slot counts as changed, so changesSince() readers that knew
+        // the storage before its contents were swapped see the new ones
+        version_ = version;
+        std::fill(slotVersions_.begin(), slotVersions_.end(), version);
+        std::fill(slotAssignVersions_.begin(), slotAssignVersions_.end(), version);
+        std::fill(blockVersions_.begin(), blockVersions_.end(), version);
+    }
+
+    int64_t Storage::toFixedWeight(float weight)
+    {
+        return std::llround(static_cast<double>(weight) * WeightScale);
+    }
+
+    uint64_t Storage::countOf(uint32_t id) const
+    {
+        const Totals* totals = totalsById_.find(id);
+        return totals ? totals->count : 0;
+    }
+
+    bool Storage::holdsContents(uint32_t id) const
+    {
+        const Totals* totals = totalsById_.find(id);
+        return totals && totals->containers > 0;
+    }
+
+    float Storage::weightOf(uint32_t id) const
+    {
+        const Totals* totals = totalsById_.find(id);
+        return totals ? static_cast<float>(static_cast<double>(totals->weight) / WeightScale) : 0.0f;
+    }
+
+    uint64_t Storage::countOfCategory(uint8_t category) const
+    {
+        return category < totalsByCategory_.size() ? totalsByCategory_[category].count : 0;
+    }
+
+    float Storage::weightOfCategory(uint8_t category) const
+    {
+        if (category >= totalsByCategory_.size()) {
+            return 0.0f;
+        }
+
+        return static_cast<float>(static_cast<double>(totalsByCategory_[category].weight) / WeightScale);
     }
 
     bool Storage::hasItem(uint32_t id) const
     {
-        return std::any_of(items_.begin(), items_.end(),
-                           [id](const std::unique_ptr<Item>& ptr) { return ptr->id() == id; });
+        return stacksById_.contains(id);
+    }
+
+    const Item *Storage::findItemById(uint32_t id) const
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Find);
+
+        const StackList* list = stacksById_.find(id);
+        return list ? items_[list->first].get() : nullptr;
+    }
+
+    int Storage::findSlot(uint32_t id) const
+    {
+        const StackList* list = stacksById_.find(id);
+        return list ? list->first : -1;
+    }
+
+    uint32_t Storage::stacksOf(uint32_t id) const
+    {
+        const StackList* list = stacksById_.find(id);
+        return list ? list->stacks : 0;
+    }
+
+    const Item *Storage::getItem(int row, int col) const
+    {
+        int anchor = getAnchor(row, col);
+        return anchor >= 0 ? items_[anchor].get() : nullptr;
+    }
+
+    const Storage *Storage::getContents(int row, int col) const
+    {
+        int anchor = getAnchor(row, col);
+        const StoragePtr* contents = anchor >= 0 ? contents_.find(anchor) : nullptr;
+        return contents ? contents->get() : nullptr;
+    }
+
+    Storage *Storage::getContents(int row, int col)
+    {
+        int anchor = getAnchor(row, col);
+        StoragePtr* contents = anchor >= 0 ? contents_.find(anchor) : nullptr;
+        return contents ? contents->get() : nullptr;
+    }
+
+    Storage::Error Storage::setContents(int row, int col, std::unique_ptr<Storage> contents)
+    {
+        if (!isValidPosition(row, col)) {
+            return Error::InvalidPosition;
+        }
+
+        int anchor = getAnchor(row, col);
+        if (anchor < 0) {
+            return Error::ItemNotFound;
+        }
+
+        if (!contents || slotCounts_[anchor] != 1 || contents_.contains(anchor)) {
+            return Error::InvalidItem;
+        }
+
+        // The item already counts, only the contents are added
+        auto error = canNest(contents.get(), 0);
+        if (error != Error::Success) {
+            return error;
+        }
+
+        attachContents(anchor, std::move(contents));
+        return Error::Success;
     }
 
-    Item *Storage::findItemById(uint32_t id) const
+    std::unique_ptr<Storage> Storage::takeContents(int row, int col)
     {
-        auto it = std::find_if(items_.begin(), items_.end(),
-                               [id](const std::unique_ptr<Item>& ptr) { return ptr->id() == id; });
+        int anchor = getAnchor(row, col);
+        if (anchor < 0 || !contents_.contains(anchor)) {
+            return nullptr;
+        }
 
-        return it != items_.end() ? it->get() : nullptr;
+        StoragePtr contents = detachContents(anchor);
+        updateOpen(anchor);
+        return contents;
     }
 
-    Item *Storage::getItem(int row, int col) const
+    int Storage::getAnchor(int row, int col) const
     {
-        if (!isValidPosition(row, col)) return nullptr;
-        return items_[row * cols_ + col].get();
+        if (!isValidPosition(row, col)) {
+            return -1;
+        }
+
+        return anchors_[row * cols_ + col];
     }
 
     int Storage::getFreeCell() const
     {
-        for (int row = 0; row < rows_; row++) {
-            for (int col = 0; col < cols_; col++)
+        return nextFreeCell(0);
+    }
+
+    int Storage::nextFreeCell(int from) const
+    {
+        INVENTORY_STATS_COUNT(freeCellSearches);
+
+        if (from < 0) {
+            from = 0;
+        }
+
+        if (from >= rows_ * cols_) {
+            return -1;
+        }
+
+        // Padding bits past the last column are kept set, so any word that
+        // is not all ones has a real free cell in it
+        int         row         = from / cols_;
+        int         col         = from % cols_;
+        size_t      word        = row * wordsPerRow_ + col / 64;
+        uint64_t    freeBits    = ~occupancy_[word] & ~Bits::lowMask(col % 64);
+        if (!freeBits)
+        {
+            word = nextFreeWord(word + 1);
+            if (word >= occupancy_.size()) {
+                return -1;
+            }
+
+            freeBits = ~occupancy_[word];
+        }
+
+        row = static_cast<int>(word / wordsPerRow_);
+        col = static_cast<int>(word % wordsPerRow_) * 64 + Bits::countTrailingZeros(freeBits);
+        return row * cols_ + col;
+    }
+
+    size_t Storage::nextFreeWord(size_t from) const
+    {
+        for (size_t i = from / 64; i < freeWords_.size(); i++)
+        {
+            INVENTORY_STATS_COUNT(freeCellWordScans);
+
+            uint64_t bits = freeWords_[i];
+            if (i == from / 64) {
+                bits &= ~Bits::lowMask(from % 64);
+            }
+
+            if (bits) {
+                return i * 64 + Bits::countTrailingZeros(bits);
+            }
+        }
+
+        return occupancy_.size();
+    }
+
+    int Storage::findPlacement(int width, int height) const
+    {
+        int first = getFreeCell();
+        if (first < 0 || (width == 1 && height == 1)) {
+            return first;
+        }
+
+        if (width * height > freeCells_) {
+            return -1;
+        }
+
+        // Rows above the first free cell are full, no footprint starts there
+        return findPlacement(occupancy_, width, height, first / cols_);
+    }
+
+    int Storage::findPlacement(const std::vector<uint64_t> &occupancy, int width, int height, int fromRow) const
+    {
+        INVENTORY_STATS_COUNT(freeCellSearches);
+
+        if (width <= 0 || height <= 0 || width > cols_ || height > rows_) {
+            return -1;
+        }
+
+        // First fit: OR the rows the footprint would cover into one bitboard,
+        // then look for width free columns in a row in it. Padding bits are
+        // set, so a run never reaches past the last column.
+        std::vector<uint64_t> free(wordsPerRow_);
+        for (int row = fromRow; row + height <= rows_; row++)
+        {
+            INVENTORY_STATS_ADD(freeCellWordScans, wordsPerRow_);
+
+            const uint64_t* words = &occupancy[row * wordsPerRow_];
+            for (int i = 0; i < wordsPerRow_; i++)
             {
-                int index = isFreeCell(row, col);
-                if (index >= 0) {
-                    return index;
+                uint64_t used = 0;
+                for (int y = 0; y < height; y++) {
+                    used |= words[y * wordsPerRow_ + i];
                 }
+                free[i] = ~used;
+            }
+
+            int col = Bits::firstRun(free.data(), wordsPerRow_, width);
+            if (col >= 0) {
+                return row * cols_ + col;
             }
         }
 
         return -1;
     }
 
+    int Storage::freeCellCount() const
+    {
+        return freeCells_;
+    }
+
     int Storage::isFreeCell(int row, int col) const
     {
         if (!isValidPosition(row, col)) {
             return -1;
         }
 
-        int index = row * cols_ + col;
-        if (!items_[index]) {
-            return index;
+        if (!isOccupied(row, col)) {
+            return row * cols_ + col;
         }
 
         return -1;
     }
 
-    bool Storage::isValidPosition(int row, int col) const
+    bool Storage::isRowFull(int row) const
     {
-        return row >= 0 && row < rows_ && col >= 0 && col < cols_;
+        return isRegionFull(row, 0, 1, cols_);
     }
 
-    Storage::Error Storage::canAddItem(const Item *item) const
+    bool Storage::isRegionFull(int row, int col, int rows, int cols) const
     {
-        if (!item) {
-            return Error::InvalidItem;
+        if (rows <= 0 || cols <= 0 || !isValidPosition(row, col) ||
+            !isValidPosition(row + rows - 1, col + cols - 1)) {
+            return false;
         }
 
-        if (maxWeight_ > 0 && currentWeight_ + item->weight() > maxWeight_) {
-            return Error::NoSpace;
+        for (int y = row; y < row + rows; y++)
+        {
+            const uint64_t* words = &occupancy_[y * wordsPerRow_];
+            for (int begin = col; begin < col + cols; )
+            {
+                int word    = begin / 64;
+                int end     = std::min(col + cols, (word + 1) * 64);
+                uint64_t mask = Bits::rangeMask(begin - word * 64, end - word * 64);
+                if ((words[word] & mask) != mask) {
+                    return false;
+                }
+
+                begin = end;
+            }
         }
 
-        return Error::Success;
+        return true;
     }
 
-    Storage::Error Storage::addItem(std::unique_ptr<Item> item)
+    bool Storage::isRegionFree(int row, int col, int rows, int cols) const
     {
-        auto error = canAddItem(item.get());
-        if (error != Error::Success) {
-            return error;
+        if (rows <= 0 || cols <= 0 || !isValidPosition(row, col) ||
+            !isValidPosition(row + rows - 1, col + cols - 1)) {
+            return false;
         }
 
-        bool isSpaceLimited = maxWeight_ > 0;
-        bool isSpaceWillBeExceeded = currentWeight_ + item->weight() > maxWeight_;
+        for (int y = row; y < row + rows; y++)
+        {
+            const uint64_t* words = &occupancy_[y * wordsPerRow_];
+            for (int begin = col; begin < col + cols; )
+            {
+                int word    = begin / 64;
+                int end     = std::min(col + cols, (word + 1) * 64);
+                if (words[word] & Bits::rangeMask(begin - word * 64, end - word * 64)) {
+                    return false;
+                }
 
-        if (isSpaceLimited && isSpaceWillBeExceeded) {
-            return Error::NoSpace;
+                begin = end;
+            }
         }
 
-        for (int row = 0; row < rows_; row++) {
-            for (int col = 0; col < cols_; col++)
-            {
-                int index = row * cols_ + col;
-                auto existingItem = items_[index].get();
-                if (!existingItem) {
-                    continue;
-                }
+        return true;
+    }
 
-                if (existingItem->canStackWith(item.get())) {
-                    existingItem->addToStack(item->stackCount());
-                    currentWeight_ += item->weight();
-                    return Error::Success;
-                }
+    bool Storage::isValidPosition(int row, int col) const
+    {
+        return row >= 0 && row < rows_ && col >= 0 && col < cols_;
+    }
+
+    bool Storage::isOccupied(int row, int col) const
+    {
+        return (occupancy_[row * wordsPerRow_ + col / 64] >> (col % 64)) & 1;
+    }
+
+    void Storage::setOccupied(int index, bool occupied)
+    {
+        int         row     = index / cols_;
+        int         col     = index % cols_;
+        size_t      i       = row * wordsPerRow_ + col / 64;
+        uint64_t&   word    = occupancy_[i];
+        uint64_t    bit     = 1ull << (col % 64);
+
+        if (((word & bit) != 0) == occupied) {
+            return;
+        }
+
+        word        = occupied ? word | bit : word & ~bit;
+        freeCells_ += occupied ? -1 : 1;
+        setFreeWord(i, word != ~0ull);
+    }
+
+    void Storage::setFootprint(int index, const ItemDefinition *definition, bool occupied)
+    {
+        int row = index / cols_;
+        int col = index % cols_;
+        for (int y = row; y < row + definition->height; y++)
+        {
+            for (int x = col; x < col + definition->width; x++) {
+                setOccupied(y * cols_ + x, occupied);
             }
         }
 
-        int index = getFreeCell();
-        if (index >= 0)
+        setAnchors(index, definition, occupied ? index : -1);
+    }
+
+    void Storage::setAnchors(int index, const ItemDefinition *definition, int anchor)
+    {
+        int row = index / cols_;
+        int col = index % cols_;
+        for (int y = row; y < row + definition->height; y++)
         {
-            currentWeight_ += item->weight();
-            items_[index] = std::move(item);
-            return Error::Success;
+            for (int x = col; x < col + definition->width; x++) {
+                anchors_[y * cols_ + x] = anchor;
+            }
         }
+    }
 
-        return Error::NoSpace;
+    void Storage::fillRegion(std::vector<uint64_t> &occupancy, int index, int width, int height) const
+    {
+        int row = index / cols_;
+        int col = index % cols_;
+        for (int y = row; y < row + height; y++)
+        {
+            for (int x = col; x < col + width; x++) {
+                occupancy[y * wordsPerRow_ + x / 64] |= 1ull << (x % 64);
+            }
+        }
     }
 
-    void Storage::clear()
+    void Storage::setFreeWord(size_t index, bool hasFree)
     {
-        items_.clear();
-        currentWeight_ = 0.0f;
+        uint64_t bit = 1ull << (index % 64);
+        freeWords_[index / 64] = hasFree ? freeWords_[index / 64] | bit : freeWords_[index / 64] & ~bit;
     }
 
-    std::unique_ptr<Item> Storage::removeItem(Item *item)
+    void Storage::resetOccupancy()
     {
-        auto it = std::find_if(items_.begin(), items_.end(),
-                               [item](const std::unique_ptr<Item>& ptr) { return ptr.get() == item; });
+        occupancy_.assign(rows_ * wordsPerRow_, 0);
+        freeWords_.assign((occupancy_.size() + 63) / 64, 0);
+        freeCells_ = rows_ * cols_;
 
-        if (it != items_.end())
+        // Mark padding past the last column as occupied
+        int tail = cols_ % 64;
+        if (tail != 0)
         {
-            auto result = std::move(*it);
-            currentWeight_ -= result->weight();
+            for (int row = 0; row < rows_; row++) {
+                occupancy_[(row + 1) * wordsPerRow_ - 1] = ~Bits::lowMask(tail);
+            }
+        }
 
-            items_.erase(it);
-            return result;
+        for (size_t i = 0; i < occupancy_.size(); i++) {
+            setFreeWord(i, occupancy_[i] != ~0ull);
         }
+    }
 
-        return nullptr;
+    Storage::Error Storage::canAddItem(const Item *item, const Storage *contents) const
+    {
+        if (!item) {
+            return Error::InvalidItem;
+        }
+
+        if (!contents) {
+            return canAddItem(item->definition(), item->stackCount());
+        }
+
+        auto error = item->stackCount() != 1 ? Error::InvalidItem : canAddItem(item->definition(), 1);
+        return error == Error::Success ? canNest(contents, toFixedWeight(item->weight())) : error;
     }
 
-    std::unique_ptr<Item> Storage::removeItemById(uint32_t id)
+    Storage::Error Storage::canNest(const Storage *contents, int64_t weight) const
+    {
+        // A storage cannot end up inside itself
+        for (const WeightNode* node = weight_.node.get(); node; node = node->parent)
+        {
+            if (node == contents->weight_.node.get()) {
+                return Error::InvalidItem;
+            }
+        }
+
+        return fitsWeight(weight + contents->exactWeight()) ? Error::Success : Error::NoSpace;
+    }
+
+    Storage::Error Storage::canAddItem(const ItemDefinition *definition, uint32_t count) const
+    {
+        if (!definition || definition->id == NoItem || count == 0 || definition->width == 0 || definition->height == 0) {
+            return Error::InvalidItem;
+        }
+
+        if (!fitsWeight(toFixedWeight(definition->weight) * count)) {
+            return Error::NoSpace;
+        }
+
+        return Error::Success;
+    }
+
+    bool Storage::fitsWeight(int64_t weight, const WeightNode* stop) const
+    {
+        for (const WeightNode* node = weight_.node.get(); node != stop; node = node->parent)
+        {
+            if (node->limit >= 0 && node->total + weight > node->limit) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void Storage::addWeight(int64_t weight)
     {
-        auto it = std::find_if(items_.begin(), items_.end(),
-                               [id](const std::unique_ptr<Item>& ptr) { return ptr->id() == id; });
+        for (WeightNode* node = weight_.node.get(); node; node = node->parent) {
+            node->total += weight;
+        }
+    }
+
+    Storage::Error Storage::addItem(std::unique_ptr<Item> item, std::unique_ptr<Storage> contents)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Add);
 
-        if (it != items_.end())
+        if (!item)
         {
-            auto result = std::move(*it);
-            currentWeight_ -= result->weight();
+            INVENTORY_STATS_COUNT(rejectedAdds);
+            return Error::InvalidItem;
+        }
 
-            items_.erase(it);
-            return result;
+        if (contents) {
+            return insertContainer(std::move(item), std::move(contents));
         }
 
-        return nullptr;
+        const ItemDefinition* definition = item->definition();
+        uint32_t count = item->stackCount();
+        return insertStack(definition, count, std::move(item));
+    }
+
+    Storage::Error Storage::emplaceItem(uint32_t id, uint32_t count)
+    {
+        return emplaceItem(ItemCatalog::shared().find(id), count);
+    }
+
+    Storage::Error Storage::emplaceItem(const ItemDefinition *definition, uint32_t count)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Emplace);
+        return insertStack(definition, count, nullptr);
+    }
+
+    Storage::Error Storage::insertStack(const ItemDefinition *definition, uint32_t count, ItemPtr item)
+    {
+        auto error = canAddItem(definition, count);
+        if (error != Error::Success)
+        {
+            INVENTORY_STATS_COUNT(rejectedAdds);
+            return error;
+        }
+
+        int         freeCell    = 0;
+        uint32_t    stacks      = newStacks(definition, count);
+        if (stacks == 0)
+        {
+            addUnits(definition, count, freeCell);
+            return Error::Success;
+        }
+
+        // The common case, one new stack and nothing to top up first
+        const StackList* list = stacksById_.find(definition->id);
+        if (stacks == 1 && (!list || list->open < 0))
+        {
+            int index = findPlacement(definition->width, definition->height);
+            if (index < 0)
+            {
+                INVENTORY_STATS_COUNT(rejectedAdds);
+                return Error::NoSpace;
+            }
+
+            // Only a new slot needs an Item, and it comes from the pool
+            INVENTORY_STATS_COUNT(newSlots);
+            placeItem(index, item ? std::move(item) : std::make_unique<Item>(definition, count));
+            return Error::Success;
+        }
+
+        // Overflow into several stacks, checked before anything changes
+        int64_t area = definition->width * definition->height;
+        bool    fits = area * stacks <= freeCells_;
+        if (fits && area > 1)
+        {
+            std::vector<uint64_t> occupancy(occupancy_);
+            fits = fitsStacks(occupancy, definition, stacks);
+        }
+
+        if (!fits)
+        {
+            INVENTORY_STATS_COUNT(rejectedAdds);
+            return Error::NoSpace;
+        }
+
+        addUnits(definition, count, freeCell);
+        return Error::Success;
+    }
+
+    Storage::Error Storage::insertContainer(ItemPtr item, StoragePtr contents)
+    {
+        const ItemDefinition* definition = item->definition();
+
+        auto error = canAddItem(item.get(), contents.get());
+        int index = error == Error::Success ? findPlacement(definition->width, definition->height) : -1;
+        if (error == Error::Success && index < 0) {
+            error = Error::NoSpace;
+        }
+
+        if (error != Error::Success)
+        {
+            INVENTORY_STATS_COUNT(rejectedAdds);
+            return error;
+        }
+
+        INVENTORY_STATS_COUNT(newSlots);
+        placeItem(index, std::move(item));
+        attachContents(index, std::move(contents));
+        return Error::Success;
+    }
+
+    void Storage::addUnits(const ItemDefinition *definition, uint32_t count, int &freeCell)
+    {
+        // Top up the stacks that still have room, then open new ones.
+        // Single cells are placed by a forward sweep from freeCell.
+        const StackList* list = stacksById_.find(definition->id);
+        for (int slot = list ? list->open : -1; slot >= 0 && count > 0; )
+        {
+            int         next    = stackLinks_[slot].nextOpen;
+            uint32_t    units   = definition->maxStack ? std::min(count, definition->maxStack - slotCounts_[slot]) : count;
+
+            INVENTORY_STATS_COUNT(stackMerges);
+            addToSlot(slot, units);
+            count  -= units;
+            slot    = next;
+        }
+
+        bool single = definition->width * definition->height == 1;
+        while (count > 0)
+        {
+            uint32_t units = definition->maxStack ? std::min(count, definition->maxStack) : count;
+            int index = single ? (freeCell = nextFreeCell(freeCell)) : findPlacement(definition->width, definition->height);
+
+            // Callers check that the new stacks fit, a grid that disagrees
+            // must not be written past
+            assert(index >= 0 && "no room for a validated stack");
+            if (index < 0) {
+                return;
+            }
+
+            INVENTORY_STATS_COUNT(newSlots);
+            placeItem(index, std::make_unique<Item>(definition, units));
+            count -= units;
+        }
+    }
+
+    void Storage::removeUnits(uint32_t id, uint32_t count)
+    {
+        // Non-full stacks go first, so full ones stay full
+        while (count > 0)
+        {
+            const StackList*    list    = stacksById_.find(id);
+            int                 slot    = list->open >= 0 ? list->open : list->first;
+            uint32_t            units   = std::min(count, slotCounts_[slot]);
+
+            removeFromSlot(slot, units);
+            count -= units;
+        }
+    }
+
+    uint32_t Storage::newStacks(const ItemDefinition *definition, uint32_t count) const
+    {
+        const StackList* list = stacksById_.find(definition->id);
+        // An unlimited stack takes everything, unless the only stacks are
+        // containers, which are never open
+        if (definition->maxStack == 0) {
+            return list && list->open >= 0 ? 0 : 1;
+        }
+
+        // Only the non-full stacks are visited
+        uint64_t room = 0;
+        for (int slot = list ? list->open : -1; slot >= 0 && room < count; slot = stackLinks_[slot].nextOpen) {
+            room += definition->maxStack - slotCounts_[slot];
+        }
+
+        if (room >= count) {
+            return 0;
+        }
+
+        return static_cast<uint32_t>((count - room + definition->maxStack - 1) / definition->maxStack);
+    }
+
+    bool Storage::fitsStacks(std::vector<uint64_t> &occupancy, const ItemDefinition *definition, uint32_t stacks) const
+    {
+        for (uint32_t i = 0; i < stacks; i++)
+        {
+            int index = findPlacement(occupancy, definition->width, definition->height, 0);
+            if (index < 0) {
+                return false;
+            }
+
+            fillRegion(occupancy, index, definition->width, definition->height);
+        }
+
+        return true;
+    }
+
+    Storage::Error Storage::emplaceItemAt(int row, int col, const ItemDefinition *definition, uint32_t count)
+    {
+        if (!isValidPosition(row, col)) {
+            return Error::InvalidPosition;
+        }
+
+        auto error = canAddItem(definition, count);
+        if (error == Error::Success) {
+            error = canPlaceAt(row, col, definition, count);
+        }
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        placeItem(row * cols_ + col, std::make_unique<Item>(definition, count));
+        return Error::Success;
+    }
+
+    Storage::Error Storage::addItemAt(int row, int col, std::unique_ptr<Item> item, std::unique_ptr<Storage> contents)
+    {
+        if (!isValidPosition(row, col)) {
+            return Error::InvalidPosition;
+        }
+
+        auto error = canAddItem(item.get(), contents.get());
+        if (error == Error::Success) {
+            error = canPlaceAt(row, col, item->definition(), item->stackCount());
+        }
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        int index = row * cols_ + col;
+        placeItem(index, std::move(item));
+        if (contents) {
+            attachContents(index, std::move(contents));
+        }
+        return Error::Success;
+    }
+
+    Storage::Error Storage::canPlaceAt(int row, int col, const ItemDefinition *definition, uint32_t count) const
+    {
+        if (!isValidPosition(row + definition->height - 1, col + definition->width - 1)) {
+            return Error::InvalidPosition;
+        }
+
+        if (definition->maxStack && count > definition->maxStack) {
+            return Error::InvalidItem;
+        }
+
+        if (!isRegionFree(row, col, definition->height, definition->width)) {
+            return Error::NoSpace;
+        }
+
+        return Error::Success;
+    }
+
+    Storage::Error Storage::canAddItems(const std::vector<ItemAmount> &items) const
+    {
+        return validateAdd(groupById(items));
+    }
+
+    Storage::Error Storage::addItems(const std::vector<ItemAmount> &items)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::AddBatch);
+
+        auto grouped = groupById(items);
+        auto error = validateAdd(grouped);
+        if (error != Error::Success) {
+            return error;
+        }
+
+        applyAdd(grouped);
+        return Error::Success;
+    }
+
+    Storage::Error Storage::removeItems(const std::vector<ItemAmount> &items)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::RemoveBatch);
+
+        auto grouped = groupById(items);
+        auto error = validateRemove(grouped);
+        if (error != Error::Success) {
+            return error;
+        }
+
+        applyRemove(grouped);
+        return Error::Success;
+    }
+
+    Storage::Error Storage::transfer(Storage &from, Storage &to, const std::vector<ItemAmount> &items)
+    {
+        if (&from == &to) {
+            return Error::Success;
+        }
+
+        // Storages above both of them keep their totals, so only the ones
+        // below the first shared one are checked for the added weight
+        auto grouped = groupById(items);
+        auto error = from.validateRemove(grouped);
+        if (error == Error::Success) {
+            error = to.validateAdd(grouped, sharedNode(from, to));
+        }
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        from.applyRemove(grouped);
+        to.applyAdd(grouped);
+        return Error::Success;
+    }
+
+    const Storage::WeightNode *Storage::sharedNode(const Storage &from, const Storage &to)
+    {
+        for (const WeightNode* node = to.weight_.node.get(); node; node = node->parent)
+        {
+            for (const WeightNode* above = from.weight_.node.get(); above; above = above->parent)
+            {
+                if (above == node) {
+                    return node;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::vector<ItemAmount> Storage::groupById(const std::vector<ItemAmount> &items)
+    {
+        std::vector<ItemAmount> grouped(items);
+        std::sort(grouped.begin(), grouped.end(),
+                  [](const ItemAmount& a, const ItemAmount& b) { return a.id < b.id; });
+
+        size_t count = 0;
+        for (const auto& amount : grouped)
+        {
+            if (count > 0 && grouped[count - 1].id == amount.id) {
+                grouped[count - 1].count += amount.count;
+            }
+            else {
+                grouped[count++] = amount;
+            }
+        }
+
+        grouped.resize(count);
+        return grouped;
+    }
+
+    Storage::Error Storage::validateAdd(const std::vector<ItemAmount> &grouped, const WeightNode* stop) const
+    {
+        const auto& catalog = ItemCatalog::shared();
+
+        int64_t weight      = 0;
+        int64_t newCells    = 0;
+        bool    footprints  = false;
+        for (const auto& amount : grouped)
+        {
+            const ItemDefinition* definition = catalog.find(amount.id);
+            if (!definition || amount.count == 0 || definition->width == 0 || definition->height == 0) {
+                return Error::InvalidItem;
+            }
+
+            weight += toFixedWeight(definition->weight) * amount.count;
+
+            int64_t stacks = newStacks(definition, amount.count);
+            newCells   += stacks * definition->width * definition->height;
+            footprints |= stacks > 0 && definition->width * definition->height > 1;
+        }
+
+        if (!fitsWeight(weight, stop)) {
+            return Error::NoSpace;
+        }
+
+        if (newCells > 0 && newCells > freeCellCount()) {
+            return Error::NoSpace;
+        }
+
+        if (footprints && !fitsFootprints(grouped)) {
+            return Error::NoSpace;
+        }
+
+        return Error::Success;
+    }
+
+    bool Storage::fitsFootprints(const std::vector<ItemAmount> &grouped) const
+    {
+        const auto& catalog = ItemCatalog::shared();
+
+        // Dry run of the first pass of applyAdd() on a copy of the bitmap.
+        // Single cells go last and always fit once the cell count does.
+        std::vector<uint64_t> occupancy(occupancy_);
+        for (const auto& amount : grouped)
+        {
+            const ItemDefinition* definition = catalog.find(amount.id);
+            if (definition->width * definition->height == 1) {
+                continue;
+            }
+
+            if (!fitsStacks(occupancy, definition, newStacks(definition, amount.count))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Storage::Error Storage::validateRemove(const std::vector<ItemAmount> &grouped) const
+    {
+        for (const auto& amount : grouped)
+        {
+            if (!hasItem(amount.id) || countOf(amount.id) < amount.count) {
+                return Error::ItemNotFound;
+            }
+
+            if (holdsContents(amount.id)) {
+                return Error::InvalidItem;
+            }
+        }
+
+        return Error::Success;
+    }
+
+    void Storage::applyAdd(const std::vector<ItemAmount> &grouped)
+    {
+        const auto& catalog = ItemCatalog::shared();
+
+        // Multi-cell items are placed first, in the same order as the dry
+        // run in fitsFootprints(). The single cells that are left are filled
+        // in a single forward sweep over the bitmap.
+        int freeCell = 0;
+        for (const auto& amount : grouped)
+        {
+            const ItemDefinition* definition = catalog.find(amount.id);
+            if (definition->width * definition->height > 1) {
+                addUnits(definition, amount.count, freeCell);
+            }
+        }
+
+        for (const auto& amount : grouped)
+        {
+            const ItemDefinition* definition = catalog.find(amount.id);
+            if (definition->width * definition->height == 1) {
+                addUnits(definition, amount.count, freeCell);
+            }
+        }
+    }
+
+    void Storage::applyRemove(const std::vector<ItemAmount> &grouped)
+    {
+        for (const auto& amount : grouped) {
+            removeUnits(amount.id, amount.count);
+        }
+    }
+
+    Storage::Error Storage::arrange(SortOrder order, bool parallel)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Arrange);
+
+        // Stacks of one id are topped up from each other first, then
+        // arranging is a sort of the stacks that are left. The top-up is
+        // only planned here and done once the arrangement is known to fit.
+        std::vector<uint32_t> compacted = compactedCounts();
+
+        std::vector<ArrangeEntry> entries;
+        entries.reserve(rows_ * cols_ - freeCells_);
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && compacted[i] > 0)
+            {
+                uint32_t rank = static_cast<uint32_t>(entries.size());
+                const ItemDefinition* definition = items_[i]->definition();
+                entries.push_back({sortKey(order, slotWeights_[i] * compacted[i], definition), rank, slotIds_[i], definition});
+            }
+        }
+
+        auto compare = [order](const ArrangeEntry& a, const ArrangeEntry& b)
+        {
+            if (a.key != b.key) {
+                return a.key < b.key;
+            }
+
+            // Names sharing their first eight bytes need the full compare
+            if (order == SortOrder::Name && a.definition->name != b.definition->name) {
+                return a.definition->name < b.definition->name;
+            }
+
+            return a.id != b.id ? a.id < b.id : a.rank < b.rank;
+        };
+
+        if (parallel) parallelSort(entries.begin(), entries.end(), compare);
+        else std::sort(entries.begin(), entries.end(), compare);
+
+        // First fit in sorted order can strand a large item behind smaller
+        // ones; retry with the biggest footprints first before giving up
+        std::vector<int>        targets;
+        std::vector<uint64_t>   occupancy;
+        if (!planArrange(entries, targets, occupancy))
+        {
+            std::stable_sort(entries.begin(), entries.end(), [](const ArrangeEntry& a, const ArrangeEntry& b) {
+                return a.definition->width * a.definition->height > b.definition->width * b.definition->height;
+            });
+
+            if (!planArrange(entries, targets, occupancy)) {
+                return Error::NoSpace;
+            }
+        }
+
+        // From here on the storage changes, the occupied slots are then
+        // exactly the ones the entries were made from
+        compactStacks(compacted);
+
+        std::vector<int> targetByRank(entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            targetByRank[entries[i].rank] = targets[i];
+        }
+
+        // Stack lists are carried over to the target slots
+        std::vector<int>        targetBySlot(slotIds_.size());
+        std::vector<StackLinks> links(stackLinks_.size());
+        uint32_t                rank = 0;
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem) {
+                targetBySlot[i] = targetByRank[rank++];
+            }
+        }
+
+        auto moved = [&targetBySlot](int slot) { return slot >= 0 ? targetBySlot[slot] : -1; };
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem)
+            {
+                const StackLinks& old = stackLinks_[i];
+                links[targetBySlot[i]] = {moved(old.next), moved(old.prev), moved(old.nextOpen), moved(old.prevOpen), old.open};
+            }
+        }
+
+        stackLinks_ = std::move(links);
+        stacksById_.forEach([&moved](uint32_t, StackList& list)
+        {
+            list.first  = moved(list.first);
+            list.open   = moved(list.open);
+        });
+
+        if (!contents_.empty())
+        {
+            IdMap<StoragePtr> contents;
+            contents_.forEach([&contents, &targetBySlot](uint32_t slot, StoragePtr& nested) {
+                contents.insert(targetBySlot[slot], std::move(nested));
+            });
+            contents_ = std::move(contents);
+        }
+
+        // Everything that moves is lifted out in slot order, then put back
+        // in target order, so both passes walk the columns front to back.
+        // Stacks already at their target stay untouched and the weight total
+        // does not change. The planned bitmap becomes the occupancy and the
+        // anchors are rebuilt. A save in progress gets its copy of the
+        // pages it has not read yet first.
+        frozen_.release();
+
+        std::vector<ItemPtr>    lifted(entries.size());
+        std::vector<uint32_t>   counts(entries.size());
+        rank = 0;
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] == NoItem) {
+                continue;
+            }
+
+            int slot = static_cast<int>(i);
+            if (targetBySlot[slot] != slot)
+            {
+                counts[rank] = slotCounts_[slot];
+                lifted[rank] = std::move(items_[slot]);
+
+                slotIds_[slot]      = NoItem;
+                slotCounts_[slot]   = 0;
+                slotWeights_[slot]  = 0.0f;
+                touchSlot(slot, true);
+            }
+
+            rank++;
+        }
+
+        anchors_.assign(anchors_.size(), -1);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const ItemDefinition*   definition  = entries[i].definition;
+            uint32_t                lift        = entries[i].rank;
+            int                     target      = targets[i];
+            setAnchors(target, definition, target);
+
+            if (!lifted[lift]) {
+                continue;
+            }
+
+            slotIds_[target]        = definition->id;
+            slotCounts_[target]     = counts[lift];
+            slotWeights_[target]    = definition->weight;
+
+            touchSlot(target, true);
+            items_[target] = std::move(lifted[lift]);
+        }
+
+        occupancy_ = std::move(occupancy);
+        for (size_t i = 0; i < occupancy_.size(); i++) {
+            setFreeWord(i, occupancy_[i] != ~0ull);
+        }
+
+        if (queryIndexes_) {
+            indexCategories();
+        }
+
+        return Error::Success;
+    }
+
+    std::vector<uint32_t> Storage::compactedCounts() const
+    {
+        // Walks each id's open stacks in list order as compactStacks() moves
+        // units: every move either fills the first open stack or empties the
+        // second, and the order of the remaining open stacks never changes
+        std::vector<uint32_t> counts = slotCounts_;
+        stacksById_.forEach([this, &counts](uint32_t, const StackList& list)
+        {
+            int to      = list.open;
+            int from    = to >= 0 ? stackLinks_[to].nextOpen : -1;
+            while (from >= 0)
+            {
+                uint32_t maxStack   = items_[to]->maxStack();
+                uint32_t units      = maxStack ? std::min(counts[from], maxStack - counts[to]) : counts[from];
+                counts[from]   -= units;
+                counts[to]     += units;
+
+                if (counts[from] == 0) {
+                    from = stackLinks_[from].nextOpen;
+                }
+
+                if (maxStack && counts[to] == maxStack)
+                {
+                    to      = from;
+                    from    = to >= 0 ? stackLinks_[to].nextOpen : -1;
+                }
+            }
+        });
+
+        return counts;
+    }
+
+    void Storage::compactStacks(const std::vector<uint32_t> &counts)
+    {
+        // Emptied and drained stacks first, so the open stacks that are left
+        // keep their order before the remaining ones are topped up
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && counts[i] < slotCounts_[i]) {
+                removeFromSlot(static_cast<int>(i), slotCounts_[i] - counts[i]);
+            }
+        }
+
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && counts[i] > slotCounts_[i]) {
+                addToSlot(static_cast<int>(i), counts[i] - slotCounts_[i]);
+            }
+        }
+    }
+
+    bool Storage::planArrange(const std::vector<ArrangeEntry> &entries, std::vector<int> &targets,
+                              std::vector<uint64_t> &occupancy) const
+    {
+        targets.resize(entries.size());
+
+        // Single cells are packed in order, first fit on an empty bitmap
+        // is only needed once a larger footprint is involved
+        occupancy.assign(occupancy_.size(), 0);
+        int tail = cols_ % 64;
+        if (tail != 0)
+        {
+            for (int row = 0; row < rows_; row++) {
+                occupancy[(row + 1) * wordsPerRow_ - 1] = ~Bits::lowMask(tail);
+            }
+        }
+
+        auto taken = [this, &occupancy](int index)
+        {
+            int row = index / cols_;
+            int col = index % cols_;
+            return (occupancy[row * wordsPerRow_ + col / 64] >> (col % 64)) & 1;
+        };
+
+        int cursor = 0;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const ItemDefinition* definition = entries[i].definition;
+
+            while (cursor < rows_ * cols_ && taken(cursor)) {
+                cursor++;
+            }
+
+            int index = cursor;
+            if (definition->width > 1 || definition->height > 1) {
+                index = findPlacement(occupancy, definition->width, definition->height, cursor / cols_);
+            }
+
+            if (index < 0 || index >= rows_ * cols_) {
+                return false;
+            }
+
+            fillRegion(occupancy, index, definition->width, definition->height);
+            targets[i] = index;
+        }
+
+        return true;
+    }
+
+    void Storage::setQueryIndexes(bool enabled)
+    {
+        queryIndexes_ = enabled;
+        nameIndex_.clear();
+        weightIndex_.clear();
+        categorySlots_.clear();
+
+        if (!enabled) {
+            return;
+        }
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem) {
+                indexSlot(static_cast<int>(i), true);
+            }
+        }
+    }
+
+    std::vector<SlotView> Storage::findByNamePrefix(std::string_view prefix) const
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Query);
+
+        std::vector<SlotView> views;
+        if (queryIndexes_)
+        {
+            for (auto it = nameIndex_.lower_bound({prefix, 0}); it != nameIndex_.end(); ++it)
+            {
+                if (it->first.substr(0, prefix.size()) != prefix) {
+                    break;
+                }
+
+                appendStacks(it->second, views);
+            }
+
+            return views;
+        }
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && items_[i]->name().substr(0, prefix.size()) == prefix) {
+                views.push_back({static_cast<int>(i), items_[i].get()});
+            }
+        }
+
+        std::sort(views.begin(), views.end(), [](const SlotView& a, const SlotView& b) {
+            return std::make_tuple(a.item->name(), a.item->id(), a.slot) < std::make_tuple(b.item->name(), b.item->id(), b.slot);
+        });
+        return views;
+    }
+
+    std::vector<SlotView> Storage::findByWeight(float minWeight, float maxWeight) const
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Query);
+
+        std::vector<SlotView> views;
+        if (queryIndexes_)
+        {
+            for (auto it = weightIndex_.lower_bound({minWeight, 0}); it != weightIndex_.end(); ++it)
+            {
+                if (it->first > maxWeight) {
+                    break;
+                }
+
+                appendStacks(it->second, views);
+            }
+
+            return views;
+        }
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && slotWeights_[i] >= minWeight && slotWeights_[i] <= maxWeight) {
+                views.push_back({static_cast<int>(i), items_[i].get()});
+            }
+        }
+
+        std::sort(views.begin(), views.end(), [](const SlotView& a, const SlotView& b) {
+            return std::make_tuple(a.item->weight(), a.item->id(), a.slot) < std::make_tuple(b.item->weight(), b.item->id(), b.slot);
+        });
+        return views;
+    }
+
+    std::vector<SlotView> Storage::findByCategory(uint8_t category) const
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Query);
+
+        std::vector<SlotView> views;
+        if (queryIndexes_)
+        {
+            if (category >= categorySlots_.size()) {
+                return views;
+            }
+
+            const auto& bits = categorySlots_[category];
+            for (size_t word = 0; word < bits.size(); word++)
+            {
+                for (uint64_t set = bits[word]; set; set &= set - 1)
+                {
+                    int slot = static_cast<int>(word * 64 + Bits::countTrailingZeros(set));
+                    views.push_back({slot, items_[slot].get()});
+                }
+            }
+
+            return views;
+        }
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem && items_[i]->category() == category) {
+                views.push_back({static_cast<int>(i), items_[i].get()});
+            }
+        }
+
+        return views;
+    }
+
+    void Storage::appendStacks(uint32_t id, std::vector<SlotView> &views) const
+    {
+        size_t first = views.size();
+        forEachStack(id, [this, &views](int slot) { views.push_back({slot, items_[slot].get()}); });
+        std::sort(views.begin() + first, views.end(), [](const SlotView& a, const SlotView& b) { return a.slot < b.slot; });
+    }
+
+    void Storage::indexSlot(int index, bool stored)
+    {
+        // Names and weights are indexed per id, until its last stack goes
+        const ItemDefinition* definition = items_[index]->definition();
+        if (stored)
+        {
+            nameIndex_.emplace(definition->name, definition->id);
+            weightIndex_.emplace(definition->weight, definition->id);
+        }
+        else if (stacksOf(definition->id) == 1)
+        {
+            nameIndex_.erase({definition->name, definition->id});
+            weightIndex_.erase({definition->weight, definition->id});
+        }
+
+        if (definition->category >= categorySlots_.size()) {
+            categorySlots_.resize(definition->category + 1);
+        }
+
+        auto& bits = categorySlots_[definition->category];
+        if (bits.empty()) {
+            bits.assign((slotIds_.size() + 63) / 64, 0);
+        }
+
+        uint64_t bit = 1ull << (index % 64);
+        bits[index / 64] = stored ? bits[index / 64] | bit : bits[index / 64] & ~bit;
+    }
+
+    void Storage::indexCategories()
+    {
+        for (auto& bits : categorySlots_) {
+            std::fill(bits.begin(), bits.end(), 0);
+        }
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem) {
+                categorySlots_[items_[i]->category()][i / 64] |= 1ull << (i % 64);
+            }
+        }
+    }
+
+    std::shared_ptr<FrozenStorage> Storage::freeze()
+    {
+        frozen_.release();
+        frozen_.snapshot = std::make_shared<FrozenStorage>(rows_, cols_, maxWeight_, version_,
+                                                           slotIds_.data(), slotCounts_.data());
+        return frozen_.snapshot;
+    }
+
+    const StorageStats &Storage::stats() const
+    {
+#if INVENTORY_STATS
+        return stats_;
+#else
+        static const StorageStats empty;
+        return empty;
+#endif
+    }
+
+    void Storage::resetStats()
+    {
+#if INVENTORY_STATS
+        stats_.reset();
+#endif
+    }
+
+    void Storage::clear()
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Clear);
+
+        for (size_t i = 0; i < slotIds_.size(); i++)
+        {
+            if (slotIds_[i] != NoItem) {
+                takeSlot(static_cast<int>(i));
+            }
+        }
+    }
+
+    std::unique_ptr<Item> Storage::removeItem(const Item *item)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Remove);
+
+        if (!item || !item->definition()) {
+            return nullptr;
+        }
+
+        const StackList* list = stacksById_.find(item->id());
+        for (int slot = list ? list->first : -1; slot >= 0; slot = stackLinks_[slot].next)
+        {
+            if (items_[slot].get() == item) {
+                return contents_.contains(slot) ? nullptr : takeSlot(slot);
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::unique_ptr<Item> Storage::removeItemById(uint32_t id)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::Remove);
+
+        const StackList* list = stacksById_.find(id);
+        if (!list) {
+            return nullptr;
+        }
+
+        // Every stack of the id goes, the units come back as one Item
+        if (holdsContents(id)) {
+            return nullptr;
+        }
+
+        ItemPtr item = takeSlot(list->first);
+        while ((list = stacksById_.find(id))) {
+            item->addToStack(takeSlot(list->first)->stackCount());
+        }
+
+        return item;
+    }
+
+    Storage::Error Storage::removeFromStack(uint32_t id, uint32_t count)
+    {
+        INVENTORY_STATS_SCOPE(StorageOp::RemoveStack);
+
+        if (!hasItem(id) || countOf(id) < count) {
+            return Error::ItemNotFound;
+        }
+
+        if (holdsContents(id)) {
+            return Error::InvalidItem;
+        }
+
+        removeUnits(id, count);
+        return Error::Success;
+    }
+
+    Storage::Error Storage::splitStack(int row, int col, uint32_t count)
+    {
+        if (!isValidPosition(row, col)) {
+            return Error::InvalidPosition;
+        }
+
+        int from = getAnchor(row, col);
+        if (from < 0) {
+            return Error::ItemNotFound;
+        }
+
+        if (count == 0 || count >= slotCounts_[from]) {
+            return Error::InvalidItem;
+        }
+
+        const ItemDefinition* definition = items_[from]->definition();
+        int index = findPlacement(definition->width, definition->height);
+        if (index < 0) {
+            return Error::NoSpace;
+        }
+
+        removeFromSlot(from, count);
+        placeItem(index, std::make_unique<Item>(definition, count));
+        return Error::Success;
+    }
+
+    Storage::Error Storage::mergeStacks(int fromRow, int fromCol, int toRow, int toCol)
+    {
+        if (!isValidPosition(fromRow, fromCol) || !isValidPosition(toRow, toCol)) {
+            return Error::InvalidPosition;
+        }
+
+        int from    = getAnchor(fromRow, fromCol);
+        int to      = getAnchor(toRow, toCol);
+        if (from < 0 || to < 0) {
+            return Error::ItemNotFound;
+        }
+
+        if (from == to || slotIds_[from] != slotIds_[to] || contents_.contains(from) || contents_.contains(to)) {
+            return Error::InvalidItem;
+        }
+
+        uint32_t maxStack   = items_[to]->maxStack();
+        uint32_t room       = maxStack ? maxStack - std::min(maxStack, slotCounts_[to]) : slotCounts_[from];
+        if (room == 0) {
+            return Error::NoSpace;
+        }
+
+        uint32_t units = std::min(slotCounts_[from], room);
+        removeFromSlot(from, units);
+        addToSlot(to, units);
+        return Error::Success;
+    }
+
+    void Storage::placeItem(int index, ItemPtr item)
+    {
+        preserveSlot(index);
+        slotIds_[index]     = item->id();
+        slotCounts_[index]  = item->stackCount();
+        slotWeights_[index] = item->weight();
+        account(item->definition(), item->stackCount());
+
+        setFootprint(index, item->definition(), true);
+        touchSlot(index, true);
+        items_[index] = std::move(item);
+        linkStack(index);
+
+        if (queryIndexes_) {
+            indexSlot(index, true);
+        }
+    }
+
+    void Storage::addToSlot(int index, uint32_t count)
+    {
+        preserveSlot(index);
+        items_[index]->addToStack(count);
+        slotCounts_[index] += count;
+        account(items_[index]->definition(), count);
+        updateOpen(index);
+        touchSlot(index, false);
+    }
+
+    void Storage::removeFromSlot(int index, uint32_t count)
+    {
+        if (count >= slotCounts_[index])
+        {
+            takeSlot(index);
+            return;
+        }
+
+        preserveSlot(index);
+        items_[index]->removeFromStack(count);
+        slotCounts_[index] -= count;
+        account(items_[index]->definition(), -static_cast<int64_t>(count));
+        updateOpen(index);
+        touchSlot(index, false);
+    }
+
+    void Storage::attachContents(int index, StoragePtr contents)
+    {
+        contents->weight_.node->parent = weight_.node.get();
+        addWeight(contents->exactWeight());
+        totalsById_.find(slotIds_[index])->containers++;
+        contents_.insert(index, std::move(contents));
+        updateOpen(index);
+    }
+
+    Storage::StoragePtr Storage::detachContents(int index)
+    {
+        StoragePtr contents = std::move(*contents_.find(index));
+        contents_.erase(index);
+        addWeight(-contents->exactWeight());
+        contents->weight_.node->parent = nullptr;
+        totalsById_.find(slotIds_[index])->containers--;
+        return contents;
+    }
+
+    std::unique_ptr<Item> Storage::takeSlot(int index)
+    {
+        preserveSlot(index);
+        if (queryIndexes_) {
+            indexSlot(index, false);
+        }
+
+        // Contents of a stack that goes away go with it
+        if (contents_.contains(index)) {
+            detachContents(index);
+        }
+
+        account(items_[index]->definition(), -static_cast<int64_t>(slotCounts_[index]));
+        unlinkStack(index);
+
+        setFootprint(index, items_[index]->definition(), false);
+
+        slotIds_[index]     = NoItem;
+        slotCounts_[index]  = 0;
+        slotWeights_[index] = 0.0f;
+        touchSlot(index, true);
+        return std::move(items_[index]);
+    }
+
+    void Storage::account(const ItemDefinition *definition, int64_t count)
+    {
+        int64_t weight = toFixedWeight(definition->weight) * count;
+        addWeight(weight);
+
+        Totals& byId = totalsById_[definition->id];
+        byId.count  += count;
+        byId.weight += weight;
+        if (byId.count == 0) {
+            totalsById_.erase(definition->id);
+        }
+
+        if (definition->category >= totalsByCategory_.size()) {
+            totalsByCategory_.resize(definition->category + 1);
+        }
+
+        Totals& byCategory = totalsByCategory_[definition->category];
+        byCategory.count    += count;
+        byCategory.weight   += weight;
+    }
+
+    void Storage::linkStack(int index)
+    {
+        StackList&  list    = stacksById_[slotIds_[index]];
+        StackLinks& links   = stackLinks_[index];
+
+        links       = StackLinks();
+        links.next  = list.first;
+        if (list.first >= 0) {
+            stackLinks_[list.first].prev = index;
+        }
+
+        list.first = index;
+        list.stacks++;
+        updateOpen(index);
+    }
+
+    void Storage::unlinkStack(int index)
+    {
+        updateOpen(index, false);
+
+        uint32_t    id      = slotIds_[index];
+        StackList&  list    = *stacksById_.find(id);
+        StackLinks& links   = stackLinks_[index];
+        if (links.prev >= 0) stackLinks_[links.prev].next = links.next;
+        else list.first = links.next;
+        if (links.next >= 0) stackLinks_[links.next].prev = links.prev;
+
+        links = StackLinks();
+        if (--list.stacks == 0) {
+            stacksById_.erase(id);
+        }
+    }
+
+    void Storage::updateOpen(int index, bool stored)
+    {
+        uint32_t    maxStack    = items_[index]->maxStack();
+        bool        open        = stored && !contents_.contains(index) && (maxStack == 0 || slotCounts_[index] < maxStack);
+        StackLinks& links       = stackLinks_[index];
+        if (links.open == open) {
+            return;
+        }
+
+        StackList& list = *stacksById_.find(slotIds_[index]);
+        if (open)
+        {
+            links.prevOpen  = -1;
+            links.nextOpen  = list.open;
+            if (list.open >= 0) {
+                stackLinks_[list.open].prevOpen = index;
+            }
+            list.open = index;
+        }
+        else
+        {
+            if (links.prevOpen >= 0) stackLinks_[links.prevOpen].nextOpen = links.nextOpen;
+            else list.open = links.nextOpen;
+            if (links.nextOpen >= 0) stackLinks_[links.nextOpen].prevOpen = links.prevOpen;
+
+            links.prevOpen  = -1;
+            links.nextOpen  = -1;
+        }
+
+        links.open = open;
+    }
+
+    void Storage::preserveFrozen(int index)
+    {
+        frozen_.snapshot->preserve(index);
+
+        // Back to the plain write path once the reader is done with the live
+        // columns or has dropped the snapshot
+        if (frozen_.snapshot->settled() || frozen_.snapshot.use_count() == 1) {
+            frozen_.snapshot.reset();
+        }
+    }
+
+    void Storage::touchSlot(int index, bool assigned)
+    {
+        version_++;
+        slotVersions_[index]        = version_;
+        blockVersions_[index / 64]  = version_;
+        if (assigned) {
+            slotAssignVersions_[index] = version_;
+        }
+    }
+
+    StorageDelta Storage::changesSince(uint64_t version) const
+    {
+        StorageDelta delta;
+        delta.fromVersion   = version;
+        delta.toVersion     = version_;
+
+        for (size_t block = 0; block < blockVersions_.size(); block++)
+        {
+            if (blockVersions_[block] <= version) {
+                continue;
+            }
+
+            size_t end = std::min(slotVersions_.size(), (block + 1) * 64);
+            for (size_t i = block * 64; i < end; i++)
+            {
+                if (slotVersions_[i] <= version) {
+                    continue;
+                }
+
+                DeltaRecord record;
+                record.slot = static_cast<uint32_t>(i);
+                if (slotIds_[i] == NoItem) {
+                    record.op = DeltaOp::SlotCleared;
+                }
+                else if (slotAssignVersions_[i] > version)
+                {
+                    record.op       = DeltaOp::SlotSet;
+                    record.id       = slotIds_[i];
+                    record.count    = slotCounts_[i];
+                }
+                else
+                {
+                    record.op       = DeltaOp::StackCount;
+                    record.count    = slotCounts_[i];
+                }
+
+                delta.records.push_back(record);
+            }
+        }
+
+        if (!delta.records.empty())
+        {
+            DeltaRecord record;
+            record.op       = DeltaOp::Weight;
+            record.weight   = currentWeight();
+            delta.records.push_back(record);
+        }
+
+        return delta;
+    }
+
+    Storage::Error Storage::applyDelta(const StorageDelta &delta)
+    {
+        // The whole delta is checked against the replica before anything
+        // changes, so a delta that does not apply leaves it as it was
+        if (delta.fromVersion != sourceVersion_ || delta.toVersion < delta.fromVersion) {
+            return Error::OutOfSync;
+        }
+
+        const auto& catalog = ItemCatalog::shared();
+        const uint32_t slots = static_cast<uint32_t>(rows_ * cols_);
+
+        // Slots that get a new stack or become empty, in slot order
+        std::vector<uint32_t> reassigned;
+        for (size_t i = 0; i < delta.records.size(); i++)
+        {
+            const auto& record = delta.records[i];
+            if (record.op == DeltaOp::Weight)
+            {
+                if (i + 1 != delta.records.size()) {
+                    return Error::InvalidPosition;
+                }
+                continue;
+            }
+
+            if (record.slot >= slots || (i > 0 && record.slot <= delta.records[i - 1].slot)) {
+                return Error::InvalidPosition;
+            }
+
+            switch (record.op)
+            {
+            case DeltaOp::SlotSet:
+                if (!catalog.find(record.id) || record.count == 0) {
+                    return Error::InvalidItem;
+                }
+                reassigned.push_back(record.slot);
+                break;
+            case DeltaOp::SlotCleared:
+                reassigned.push_back(record.slot);
+                break;
+            case DeltaOp::StackCount:
+                if (slotIds_[record.slot] == NoItem || record.count == 0) {
+                    return Error::ItemNotFound;
+                }
+                break;
+            default:
+                return Error::InvalidItem;
+            }
+        }
+
+        // New footprints have to fit the grid, on cells that are free once
+        // the reassigned slots are emptied and not claimed by another new stack
+        std::vector<uint32_t> claimed;
+        for (const auto& record : delta.records)
+        {
+            if (record.op != DeltaOp::SlotSet) {
+                continue;
+            }
+
+            const ItemDefinition* definition = catalog.find(record.id);
+            int row = static_cast<int>(record.slot) / cols_;
+            int col = static_cast<int>(record.slot) % cols_;
+            if (row + definition->height > rows_ || col + definition->width > cols_) {
+                return Error::InvalidPosition;
+            }
+
+            for (int y = row; y < row + definition->height; y++)
+            {
+                for (int x = col; x < col + definition->width; x++)
+                {
+                    int anchor = anchors_[y * cols_ + x];
+                    if (anchor >= 0 && !std::binary_search(reassigned.begin(), reassigned.end(), static_cast<uint32_t>(anchor))) {
+                        return Error::InvalidPosition;
+                    }
+                    claimed.push_back(static_cast<uint32_t>(y * cols_ + x));
+                }
+            }
+        }
+
+        std::sort(claimed.begin(), claimed.end());
+        if (std::adjacent_find(claimed.begin(), claimed.end()) != claimed.end()) {
+            return Error::InvalidPosition;
+        }
+
+        // Empty every reassigned slot first, so an item moving between
+        // slots is never present twice while the delta is replayed
+        for (const auto& record : delta.records)
+        {
+            bool reassigned = record.op == DeltaOp::SlotSet || record.op == DeltaOp::SlotCleared;
+            if (reassigned && slotIds_[record.slot] != NoItem) {
+                takeSlot(record.slot);
+            }
+        }
+
+        for (const auto& record : delta.records)
+        {
+            int index = static_cast<int>(record.slot);
+            switch (record.op)
+            {
+            case DeltaOp::SlotSet:
+                placeItem(index, std::make_unique<Item>(catalog.find(record.id), record.count));
+                break;
+            case DeltaOp::StackCount:
+                if (record.count > slotCounts_[index]) {
+                    addToSlot(index, record.count - slotCounts_[index]);
+                }
+                else if (record.count < slotCounts_[index]) {
+                    removeFromSlot(index, slotCounts_[index] - record.count);
+                }
+                break;
+            case DeltaOp::Weight:
+                // The replica keeps its own exact total from the slot records
+                break;
+            case DeltaOp::SlotCleared:
+                break;
+            }
+        }
+
+        sourceVersion_ = delta.toVersion;
+        return Error::Success;
     }
 }
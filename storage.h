@@ -3,9 +3,39 @@
 
 #include <vector>
 #include <memory>
+#include <set>
+#include <string_view>
+#include <utility>
+#include "frozen_storage.h"
 #include "item.h"
+#include "id_map.h"
+#include "journal.h"
+#include "storage_stats.h"
 
 namespace Inventory {
+    // A number of units of one item, used by the batch operations
+    struct ItemAmount
+    {
+        uint32_t    id      {0};
+        uint32_t    count   {1};
+    };
+
+    // A stored stack as returned by the queries, no Item is copied
+    struct SlotView
+    {
+        int         slot    {-1};
+        const Item* item    {nullptr};
+    };
+
+    // Sort key of one stack, used by Storage::arrange()
+    struct ArrangeEntry
+    {
+        uint64_t                key;        // leading sort field packed into an integer
+        uint32_t                rank;       // position among the occupied slots
+        uint32_t                id;
+        const ItemDefinition*   definition;
+    };
+
     class Storage
     {
     public:
@@ -15,37 +45,370 @@ namespace Inventory {
             NoSpace,
             InvalidItem,
             ItemNotFound,
+            InvalidPosition,
+            OutOfSync,          // a delta for another version than the replica's
         };
 
+        enum class SortOrder
+        {
+            Id,
+            Weight,     // heaviest stack first
+            Name,
+        };
+
+        // Id stored in slotIds() for empty slots
+        static constexpr uint32_t NoItem = IdMap<int>::EmptyKey;
+
         explicit Storage(int rows, int cols, float maxWeight = -1.0f);
+        ~Storage();
+
+        // A moved-from storage is left as an empty grid of the same size and
+        // weight limit, at a newer version and still nested where it was.
+        // Saves in progress of either storage are settled first.
+        Storage(Storage&& other);
+        Storage& operator=(Storage&& other);
+
+        // Weights are summed in fixed point, WeightScale units per 1.0, so
+        // totals are exact and do not drift over a long session
+        static constexpr int64_t WeightScale = 1000;
+        static int64_t  toFixedWeight(float weight);
 
         inline int      rows()              const   { return rows_; }
         inline int      cols()              const   { return cols_; }
+        // Weights include the contents of nested containers, which update
+        // them in O(depth) on every change
         inline float    maxWeight()         const   { return maxWeight_; }
-        inline float    currentWeight()     const   { return currentWeight_; }
+        inline float    currentWeight()     const   { return static_cast<float>(static_cast<double>(exactWeight()) / WeightScale); }
+        inline int64_t  exactWeight()       const   { return weight_.node->total; }
+        // True while this storage is nested in another one
+        inline bool     isNested()          const   { return weight_.node->parent != nullptr; }
+
+        // Modification counter, bumped on every slot change
+        inline uint64_t version()           const   { return version_; }
+
+        // Running totals of the stacks stored here, updated in O(1) by every
+        // change. Nested contents are not included.
+        uint64_t    countOf(uint32_t id)                const;
+        float       weightOf(uint32_t id)               const;
+        uint64_t    countOfCategory(uint8_t category)   const;
+        float       weightOfCategory(uint8_t category)  const;
 
-        bool    hasItem(uint32_t id)                const;
-        Item*   findItemById(uint32_t id)           const;
-        Error   canAddItem(const Item* item)        const;
-        Error   addItem(std::unique_ptr<Item> item);
+        // An id may be spread over several stacks of at most maxStack units.
+        // findItemById() and findSlot() return one of them, stacksOf() tells
+        // how many there are and forEachStack() visits their slots.
+        bool        hasItem(uint32_t id)                const;
+        const Item* findItemById(uint32_t id)           const;
+        int         findSlot(uint32_t id)               const;
+        uint32_t    stacksOf(uint32_t id)               const;
 
-        Item*   getItem(int row, int col)           const;
-        int     getFreeCell()                       const;
-        int     isFreeCell(int row, int col)        const;
-        bool    isValidPosition(int row, int col)   const;
+        // The weight limit of this storage and of every storage it is nested
+        // in is checked. An item added with contents, such as a bag, is
+        // a stack of one that takes a slot of its own, never merges and
+        // brings the weight of its contents.
+        Error       canAddItem(const Item* item, const Storage* contents = nullptr) const;
+        Error       canAddItem(const ItemDefinition* definition, uint32_t count) const;
+        Error       addItem(std::unique_ptr<Item> item, std::unique_ptr<Storage> contents = nullptr);
 
+        template <typename Func>
+        void        forEachStack(uint32_t id, Func&& func) const
+        {
+            const StackList* list = stacksById_.find(id);
+            for (int slot = list ? list->first : -1; slot >= 0; slot = stackLinks_[slot].next) {
+                func(slot);
+            }
+        }
+
+        // Adds count units without building an Item first. Units go into the
+        // non-full stacks of the id first and overflow into new stacks, so
+        // only the touched stacks are visited. Filling a stack never
+        // allocates, a new slot takes an Item from the pool.
+        Error       emplaceItem(uint32_t id, uint32_t count = 1);
+        Error       emplaceItem(const ItemDefinition* definition, uint32_t count = 1);
+
+        // Places a new stack with its footprint anchored at a specific cell,
+        // used when restoring saved state. Fails if any covered cell is taken
+        // or the count is over the stack limit.
+        Error       emplaceItemAt(int row, int col, const ItemDefinition* definition, uint32_t count = 1);
+        // The same for an existing item, optionally with contents
+        Error       addItemAt(int row, int col, std::unique_ptr<Item> item, std::unique_ptr<Storage> contents = nullptr);
+
+        // Moves count units of the stack covering a cell into a new stack at
+        // the first free placement
+        Error       splitStack(int row, int col, uint32_t count);
+
+        // Moves as many units as fit from one stack into another stack of the
+        // same item, the source stack goes away once it is empty
+        Error       mergeStacks(int fromRow, int fromCol, int toRow, int toCol);
+
+        // Batch operations. Amounts are grouped by id, validated once and
+        // applied all-or-nothing: on error the storage is left untouched.
+        // Ids with a stack holding contents cannot be removed by count.
+        Error       canAddItems(const std::vector<ItemAmount>& items)       const;
+        Error       addItems(const std::vector<ItemAmount>& items);
+        Error       removeItems(const std::vector<ItemAmount>& items);
+        static Error transfer(Storage& from, Storage& to, const std::vector<ItemAmount>& items);
+
+        // Sorts the stacks and packs them towards the first cell in one pass,
+        // without reallocating items. The parallel sort is for very large
+        // containers. Fails with NoSpace (and changes nothing) if multi-cell
+        // items cannot be packed.
+        Error       arrange(SortOrder order, bool parallel = false);
+
+        // Queries. With query indexes enabled they are answered from a name
+        // set, a unit-weight set and per-category slot bitmaps kept up to
+        // date on every change; without them they scan the slots. Results
+        // come in name, weight and slot order respectively.
+        void                    setQueryIndexes(bool enabled);
+        inline bool             hasQueryIndexes()   const   { return queryIndexes_; }
+        std::vector<SlotView>   findByNamePrefix(std::string_view prefix)       const;
+        std::vector<SlotView>   findByWeight(float minWeight, float maxWeight)  const;  // unit weight, inclusive
+        std::vector<SlotView>   findByCategory(uint8_t category)                const;
+
+        // Items cover width() x height() cells. getItem() returns the item
+        // covering a cell, getAnchor() the slot that holds it (-1 if none).
+        const Item* getItem(int row, int col)           const;
+        int         getAnchor(int row, int col)         const;
+        int         getFreeCell()                       const;
+        int         findPlacement(int width, int height) const;
+        int         freeCellCount()                     const;
+        int         isFreeCell(int row, int col)        const;
+        bool        isRowFull(int row)                  const;
+        bool        isRegionFull(int row, int col, int rows, int cols) const;
+        bool        isRegionFree(int row, int col, int rows, int cols) const;
+        bool        isValidPosition(int row, int col)   const;
+
+        // Per-slot columns (row-major, rows() * cols() entries) for dense scans.
+        // Stacks are stored at the anchor slot only.
+        inline const std::vector<uint32_t>& slotIds()       const   { return slotIds_; }
+        inline const std::vector<uint32_t>& slotCounts()    const   { return slotCounts_; }
+        inline const std::vector<float>&    slotWeights()   const   { return slotWeights_; }
+        inline const std::vector<uint64_t>& slotVersions()  const   { return slotVersions_; }
+
+        // Delta replication. changesSince() lists every slot changed after the
+        // given version (cost proportional to the changed 64-slot blocks).
+        // applyDelta() replays it on a replica that was at fromVersion
+        // (sourceVersion(), 0 for a new storage) and fails with OutOfSync
+        // otherwise. The whole delta is checked first, a delta that fails
+        // changes nothing. The weight limit is not enforced, the source
+        // already did.
+        StorageDelta            changesSince(uint64_t version) const;
+        Error                   applyDelta(const StorageDelta& delta);
+        inline uint64_t         sourceVersion() const   { return sourceVersion_; }
+
+        // Freezes the id and count columns for a save on another thread (see
+        // FrozenStorage). Costs one byte and one pointer per 1024 slots, the
+        // slots themselves are only copied when they change before the save
+        // has read them. A new freeze settles the previous one first.
+        std::shared_ptr<FrozenStorage>  freeze();
+
+        // Operation counters and latencies, all zero unless the core is built
+        // with INVENTORY_STATS
+        const StorageStats&     stats() const;
+        void                    resetStats();
+
+        // Nested storages live in this storage next to the stacks holding
+        // them, so items stay small. getContents() returns the contents of
+        // the stack covering a cell. setContents() gives a stored stack of
+        // one contents, takeContents() takes them out again.
+        const Storage*              getContents(int row, int col)   const;
+        Storage*                    getContents(int row, int col);
+        Error                       setContents(int row, int col, std::unique_ptr<Storage> contents);
+        std::unique_ptr<Storage>    takeContents(int row, int col);
+
+        // Stacks holding contents are only removed by clear(), removeItem()
+        // and removeItemById() return null for them until the contents have
+        // been taken out.
         void                    clear();
-        std::unique_ptr<Item>   removeItem(Item* item);
+        std::unique_ptr<Item>   removeItem(const Item* item);
+        // Takes every stack of the id as one Item
         std::unique_ptr<Item>   removeItemById(uint32_t id);
+        // Removes count units of the id, from its non-full stacks first.
+        // Fails with InvalidItem if a stack of the id holds contents.
+        Error                   removeFromStack(uint32_t id, uint32_t count = 1);
 
     private:
-        using ItemPtr   = std::unique_ptr<Item>;
+        using ItemPtr       = std::unique_ptr<Item>;
+        using StoragePtr    = std::unique_ptr<Storage>;
+
+        struct Totals
+        {
+            uint64_t    count       {0};
+            int64_t     weight      {0};    // fixed point
+            uint32_t    containers  {0};    // stacks holding contents
+        };
+
+        // Weight total and limit, on the heap so that nested storages can link
+        // to it and the link survives moves of this storage
+        struct WeightNode
+        {
+            int64_t     total   {0};        // fixed point, nested contents included
+            int64_t     limit   {-1};       // fixed point, negative for no limit
+            WeightNode* parent  {nullptr};
+        };
+
+        // Owns the node. When two storages swap contents the nodes go with
+        // the contents, since nested storages link to them, while the links
+        // to the parents stay: each parent chain gets the other's total.
+        struct WeightLink
+        {
+            std::unique_ptr<WeightNode> node {std::make_unique<WeightNode>()};
+
+            void swap(WeightLink& other)
+            {
+                node.swap(other.node);
+                std::swap(node->parent, other.node->parent);
+
+                int64_t change = node->total - other.node->total;
+                for (WeightNode* parent = node->parent; parent; parent = parent->parent) {
+                    parent->total += change;
+                }
+                for (WeightNode* parent = other.node->parent; parent; parent = parent->parent) {
+                    parent->total -= change;
+                }
+            }
+        };
+
+        // Stacks of one id as two intrusive lists through stackLinks_: all
+        // of them, and those that still have room
+        struct StackList
+        {
+            int         first   {-1};
+            int         open    {-1};
+            uint32_t    stacks  {0};
+        };
+
+        struct StackLinks
+        {
+            int         next        {-1};
+            int         prev        {-1};
+            int         nextOpen    {-1};
+            int         prevOpen    {-1};
+            bool        open        {false};
+        };
+
+        // Snapshot being read from the live columns, if any
+        struct FrozenLink
+        {
+            std::shared_ptr<FrozenStorage>  snapshot;
+
+            void release()
+            {
+                // Nothing to keep if the reader already dropped it
+                if (snapshot && snapshot.use_count() > 1) {
+                    snapshot->preserveAll();
+                }
+                snapshot.reset();
+            }
+        };
+
+        inline void preserveSlot(int index) { if (frozen_.snapshot) preserveFrozen(index); }
+        void        preserveFrozen(int index);
+
+        Error   insertStack(const ItemDefinition* definition, uint32_t count, ItemPtr item);
+        Error   insertContainer(ItemPtr item, StoragePtr contents);
+        Error   canNest(const Storage* contents, int64_t weight)        const;
+        void    attachContents(int index, StoragePtr contents);
+        StoragePtr detachContents(int index);
+        // The walk up the parent chain ends before stop, the first storage
+        // whose total a transfer does not change
+        bool    fitsWeight(int64_t weight, const WeightNode* stop = nullptr) const;
+        void    addWeight(int64_t weight);
+        void    addUnits(const ItemDefinition* definition, uint32_t count, int& freeCell);
+        void    removeUnits(uint32_t id, uint32_t count);
+        Error   canPlaceAt(int row, int col, const ItemDefinition* definition, uint32_t count) const;
+        bool    holdsContents(uint32_t id)                              const;
+        std::vector<uint32_t> compactedCounts()                         const;
+        void    compactStacks(const std::vector<uint32_t>& counts);
+        uint32_t newStacks(const ItemDefinition* definition, uint32_t count) const;
+        bool    fitsStacks(std::vector<uint64_t>& occupancy, const ItemDefinition* definition, uint32_t stacks) const;
+
+        static std::vector<ItemAmount> groupById(const std::vector<ItemAmount>& items);
+        static const WeightNode* sharedNode(const Storage& from, const Storage& to);
+        Error   validateAdd(const std::vector<ItemAmount>& grouped, const WeightNode* stop = nullptr) const;
+        Error   validateRemove(const std::vector<ItemAmount>& grouped)  const;
+        void    applyAdd(const std::vector<ItemAmount>& grouped);
+        void    applyRemove(const std::vector<ItemAmount>& grouped);
+        bool    planArrange(const std::vector<ArrangeEntry>& entries, std::vector<int>& targets,
+                            std::vector<uint64_t>& occupancy) const;
+        int     nextFreeCell(int from)                                  const;
+        size_t  nextFreeWord(size_t from)                               const;
+        int     findPlacement(const std::vector<uint64_t>& occupancy, int width, int height, int fromRow) const;
+        bool    fitsFootprints(const std::vector<ItemAmount>& grouped)  const;
+        void    fillRegion(std::vector<uint64_t>& occupancy, int index, int width, int height) const;
+
+        void    placeItem(int index, ItemPtr item);
+        void    addToSlot(int index, uint32_t count);
+        void    removeFromSlot(int index, uint32_t count);
+        ItemPtr takeSlot(int index);
+        void    touchSlot(int index, bool assigned);
+        void    account(const ItemDefinition* definition, int64_t count);
+        void    linkStack(int index);
+        void    unlinkStack(int index);
+        void    updateOpen(int index, bool stored = true);
+        bool    isOccupied(int row, int col) const;
+        void    setOccupied(int index, bool occupied);
+        void    setFootprint(int index, const ItemDefinition* definition, bool occupied);
+        void    setAnchors(int index, const ItemDefinition* definition, int anchor);
+        void    indexSlot(int index, bool stored);
+        void    appendStacks(uint32_t id, std::vector<SlotView>& views) const;
+        void    indexCategories();
+        void    setFreeWord(size_t index, bool hasFree);
+        void    resetOccupancy();
+        void    swapContents(Storage& other);
+        void    touchAll(uint64_t version);
+
+        FrozenLink              frozen_;
 
         int                     rows_;
         int                     cols_;
         float                   maxWeight_;
-        float                   currentWeight_;
+        int64_t                 maxWeightFixed_;
         std::vector<ItemPtr>    items_;
+        IdMap<StoragePtr>       contents_;      // nested storages by anchor slot
+
+        // Linked to the node of the storage this one is nested in, if any
+        WeightLink              weight_;
+
+        IdMap<Totals>           totalsById_;
+        std::vector<Totals>     totalsByCategory_;
+
+        // Hot per-slot data kept in parallel arrays next to items_
+        std::vector<uint32_t>   slotIds_;
+        std::vector<uint32_t>   slotCounts_;
+        std::vector<float>      slotWeights_;
+
+        // Change tracking: version of the last change of each slot, of the
+        // last time a slot got a different item, and the newest per 64 slots
+        uint64_t                version_        {0};
+        uint64_t                sourceVersion_  {0};    // of the source, after applyDelta()
+        std::vector<uint64_t>   slotVersions_;
+        std::vector<uint64_t>   slotAssignVersions_;
+        std::vector<uint64_t>   blockVersions_;
+
+        IdMap<StackList>        stacksById_;
+        std::vector<StackLinks> stackLinks_;
+
+        // One bit per cell, each row padded to whole 64-bit words, plus one
+        // bit per occupancy word that still has a free cell
+        int                     wordsPerRow_;
+        int                     freeCells_;
+        std::vector<uint64_t>   occupancy_;
+        std::vector<uint64_t>   freeWords_;
+
+        // Anchor slot of the item covering each cell, -1 for free cells
+        std::vector<int>        anchors_;
+
+        // Optional query indexes. Names and weights are keyed by id, so
+        // only new and removed stacks touch them; the category bitmaps
+        // have one bit per slot.
+        bool                                            queryIndexes_   {false};
+        std::set<std::pair<std::string_view, uint32_t>> nameIndex_;
+        std::set<std::pair<float, uint32_t>>            weightIndex_;
+        std::vector<std::vector<uint64_t>>              categorySlots_;
+
+#if INVENTORY_STATS
+        mutable StorageStats    stats_;
+#endif
     };
 }
 
@@ -0,0 +1,179 @@
+#ifndef STORAGE_STATS_H
+#define STORAGE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Storage instrumentation is compiled in only with INVENTORY_STATS=1
+// (CMake option INVENTORY_ENABLE_STATS). Without it the macros below expand
+// to nothing and Storage carries no extra state.
+#ifndef INVENTORY_STATS
+#define INVENTORY_STATS 0
+#endif
+
+namespace Inventory {
+    enum class StorageOp
+    {
+        Add,
+        Emplace,
+        AddBatch,
+        Remove,
+        RemoveStack,
+        RemoveBatch,
+        Find,
+        Clear,
+        Arrange,
+        Query,
+        Count
+    };
+
+    // Counter bumped with relaxed atomics: const Storage methods count too,
+    // and they may run on several threads at once. Copies take the value.
+    class StatCounter
+    {
+    public:
+        StatCounter() = default;
+        StatCounter(const StatCounter& other) : value_(other.load()) {}
+        StatCounter& operator=(const StatCounter& other)
+        {
+            value_.store(other.load(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        inline uint64_t load()              const   { return value_.load(std::memory_order_relaxed); }
+        inline          operator uint64_t() const   { return load(); }
+        inline void     add(uint64_t count = 1)     { value_.fetch_add(count, std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value_ {0};
+    };
+
+    // Latency histogram with power-of-two nanosecond buckets
+    struct LatencyHistogram
+    {
+        static constexpr int Buckets = 40;
+
+        StatCounter counts[Buckets];
+        StatCounter total;
+
+        void record(uint64_t nanoseconds)
+        {
+            int bucket = 0;
+            while (nanoseconds > 1 && bucket < Buckets - 1)
+            {
+                nanoseconds >>= 1;
+                bucket++;
+            }
+
+            counts[bucket].add();
+            total.add();
+        }
+
+        // Approximate percentile in nanoseconds, interpolated inside a bucket.
+        // Counts read while other threads record may be off by those calls.
+        double percentile(double q) const
+        {
+            uint64_t recorded = total;
+            if (recorded == 0) {
+                return 0.0;
+            }
+
+            double target = q * static_cast<double>(recorded);
+            double seen = 0.0;
+            for (int bucket = 0; bucket < Buckets; bucket++)
+            {
+                uint64_t count = counts[bucket];
+                if (count == 0) {
+                    continue;
+                }
+
+                if (seen + count >= target)
+                {
+                    double low  = bucket == 0 ? 0.0 : static_cast<double>(1ull << bucket);
+                    double high = static_cast<double>(2ull << bucket);
+                    return low + (high - low) * (target - seen) / count;
+                }
+
+                seen += count;
+            }
+
+            return static_cast<double>(2ull << (Buckets - 1));
+        }
+    };
+
+    struct StorageStats
+    {
+        struct Op
+        {
+            StatCounter         calls;
+            LatencyHistogram    latency;
+        };
+
+        Op          ops[static_cast<int>(StorageOp::Count)];
+
+        // Which path the adds took
+        StatCounter stackMerges;        // merged into a stack found through the index
+        StatCounter newSlots;           // needed a new slot
+        StatCounter rejectedAdds;       // refused (weight, space or invalid item)
+
+        // Free cell searches and how many summary words they had to scan
+        StatCounter freeCellSearches;
+        StatCounter freeCellWordScans;
+
+        inline const Op& op(StorageOp op) const { return ops[static_cast<int>(op)]; }
+
+        void reset() { *this = StorageStats(); }
+
+        static const char* opName(StorageOp op)
+        {
+            switch (op)
+            {
+            case StorageOp::Add:            return "addItem";
+            case StorageOp::Emplace:        return "emplaceItem";
+            case StorageOp::AddBatch:       return "addItems";
+            case StorageOp::Remove:         return "removeItem";
+            case StorageOp::RemoveStack:    return "removeFromStack";
+            case StorageOp::RemoveBatch:    return "removeItems";
+            case StorageOp::Find:           return "findItemById";
+            case StorageOp::Clear:          return "clear";
+            case StorageOp::Arrange:        return "arrange";
+            case StorageOp::Query:          return "query";
+            default:                        return "";
+            }
+        }
+    };
+
+#if INVENTORY_STATS
+    // Counts a call and records its duration when it goes out of scope
+    class StatsScope
+    {
+    public:
+        StatsScope(StorageStats& stats, StorageOp op)
+            : op_(stats.ops[static_cast<int>(op)])
+            , start_(std::chrono::steady_clock::now()) {}
+
+        ~StatsScope()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            op_.calls.add();
+            op_.latency.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+    private:
+        StorageStats::Op&                       op_;
+        std::chrono::steady_clock::time_point   start_;
+    };
+
+#define INVENTORY_STATS_SCOPE(op)       Inventory::StatsScope statsScope_(stats_, op)
+#define INVENTORY_STATS_COUNT(counter)  (stats_.counter.add())
+#define INVENTORY_STATS_ADD(counter, n) (stats_.counter.add(n))
+#else
+#define INVENTORY_STATS_SCOPE(op)       ((void)0)
+#define INVENTORY_STATS_COUNT(counter)  ((void)0)
+#define INVENTORY_STATS_ADD(counter, n) ((void)0)
+#endif
+}
+
+#endif // STORAGE_STATS_H
@@ -0,0 +1,85 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace Inventory {
+    // Interns strings into large append-only blocks. Every distinct string is
+    // stored once, null-terminated, and its view stays valid until clear().
+    class StringPool
+    {
+    public:
+        explicit StringPool(size_t blockSize = 64 * 1024)
+            : blockSize_(blockSize) {}
+
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+        std::string_view intern(std::string_view text)
+        {
+            auto it = strings_.find(text);
+            if (it != strings_.end()) {
+                return *it;
+            }
+
+            char* data = allocate(text.size() + 1);
+            if (!text.empty()) {
+                std::memcpy(data, text.data(), text.size());
+            }
+            data[text.size()] = '\0';
+
+            std::string_view result(data, text.size());
+            strings_.insert(result);
+            return result;
+        }
+
+        inline size_t   size()  const { return strings_.size(); }
+        inline size_t   bytes() const { return bytes_; }
+
+        void clear()
+        {
+            strings_.clear();
+            blocks_.clear();
+            oversized_.clear();
+            blockUsed_  = 0;
+            bytes_      = 0;
+        }
+
+    private:
+        char* allocate(size_t size)
+        {
+            bytes_ += size;
+
+            // Oversized strings get a block of their own, kept apart so it
+            // never becomes the block that is filled next
+            if (size > blockSize_ / 4)
+            {
+                oversized_.push_back(std::make_unique<char[]>(size));
+                return oversized_.back().get();
+            }
+
+            if (blocks_.empty() || blockUsed_ + size > blockSize_)
+            {
+                blocks_.push_back(std::make_unique<char[]>(blockSize_));
+                blockUsed_ = 0;
+            }
+
+            char* data = blocks_.back().get() + blockUsed_;
+            blockUsed_ += size;
+            return data;
+        }
+
+        size_t                                  blockSize_;
+        size_t                                  blockUsed_  {0};
+        size_t                                  bytes_      {0};
+        std::vector<std::unique_ptr<char[]>>    blocks_;
+        std::vector<std::unique_ptr<char[]>>    oversized_;
+        std::unordered_set<std::string_view>    strings_;
+    };
+}
+
+#endif // STRING_POOL_H
@@ -0,0 +1,186 @@
+// Background saves: the storages keep changing while AsyncSnapshotWriter
+// encodes them, and every saved record must match the slots as they were
+// at the moment of the freeze.
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <random>
+
+#include "check.h"
+#include "snapshot.h"
+
+using namespace Inventory;
+
+namespace {
+    using Records = std::vector<Snapshot::SlotRecord>;
+
+    constexpr uint32_t FirstId  = 9000;
+    constexpr uint32_t Ids      = 400;
+
+    std::mt19937 random(7);
+
+    Records capture(const Storage& storage)
+    {
+        Records records;
+        for (size_t i = 0; i < storage.slotIds().size(); i++)
+        {
+            if (storage.slotIds()[i] != Storage::NoItem) {
+                records.push_back({static_cast<uint32_t>(i), storage.slotIds()[i], storage.slotCounts()[i]});
+            }
+        }
+        return records;
+    }
+
+    bool matches(const StorageView& view, const Records& records)
+    {
+        if (!view || view.slotCount() != records.size()) {
+            return false;
+        }
+
+        size_t i = 0;
+        for (const auto& record : view)
+        {
+            if (record.slot != records[i].slot || record.id != records[i].id || record.count != records[i].count) {
+                return false;
+            }
+            i++;
+        }
+        return true;
+    }
+
+    void mutate(Storage& storage, int changes)
+    {
+        for (int i = 0; i < changes; i++)
+        {
+            int         op  = random() % 100;
+            uint32_t    id  = FirstId + random() % Ids;
+            int         row = random() % storage.rows();
+            int         col = random() % storage.cols();
+
+            if (op < 40) storage.emplaceItem(id, 1 + random() % 5);
+            else if (op < 75) storage.removeFromStack(id, 1 + random() % 5);
+            else if (op < 85) storage.splitStack(row, col, 1);
+            else if (op < 95) storage.mergeStacks(row, col, random() % storage.rows(), random() % storage.cols());
+            else if (op < 96 && random() % 50 == 0) storage.arrange(Storage::SortOrder::Name);
+            else storage.removeItemById(id);
+        }
+    }
+
+    SnapshotShard openShard(const std::string& path)
+    {
+        SnapshotShard shard;
+        CHECK(shard.open(path));
+        return shard;
+    }
+
+    // Changes on the owner thread for as long as the save is in flight
+    void testMutateWhileSaving(AsyncSnapshotWriter& writer, const std::string& path)
+    {
+        int batches = 0;
+        for (int round = 0; round < 12; round++)
+        {
+            Storage large(100 + round, 200);
+            Storage small(7, 9);
+            mutate(large, 20000);
+            mutate(small, 200);
+
+            Records expectedLarge   = capture(large);
+            Records expectedSmall   = capture(small);
+            auto    done            = writer.save(path, {{1, &large}, {2, &small}});
+            do
+            {
+                mutate(large, 50);
+                mutate(small, 5);
+                batches++;
+            }
+            while (done.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+
+            CHECK(done.get());
+            SnapshotShard shard = openShard(path);
+            CHECK(matches(shard.find(1), expectedLarge));
+            CHECK(matches(shard.find(2), expectedSmall));
+        }
+
+        CHECK(batches > 0);
+    }
+
+    // A second freeze settles the first, and the storage may be replaced
+    // or destroyed while both are still queued
+    void testQueuedFreezes(AsyncSnapshotWriter& writer, const std::string& path)
+    {
+        for (int round = 0; round < 8; round++)
+        {
+            auto storage = std::make_unique<Storage>(200, 200);
+            mutate(*storage, 30000);
+
+            Records first   = capture(*storage);
+            auto    frozen  = storage->freeze();
+            mutate(*storage, 3000);
+
+            Records second      = capture(*storage);
+            auto    savedSecond = writer.save(path + "2", {{5, storage.get()}});
+            auto    savedFirst  = writer.save(path, {AsyncSnapshotWriter::Frozen {4, frozen}});
+            frozen.reset();
+
+            if (round % 2) {
+                storage.reset();
+            }
+            else {
+                *storage = Storage(10, 10);
+            }
+
+            CHECK(savedSecond.get());
+            CHECK(savedFirst.get());
+            CHECK(matches(openShard(path).find(4), first));
+            CHECK(matches(openShard(path + "2").find(5), second));
+        }
+    }
+
+    // Arrange moves every slot during the save, the shard then restores
+    // into a storage with the frozen layout
+    void testArrangeWhileSaving(AsyncSnapshotWriter& writer, const std::string& path)
+    {
+        Storage storage(64, 64);
+        mutate(storage, 5000);
+
+        Records expected    = capture(storage);
+        auto    done        = writer.save(path, {{1, &storage}});
+        storage.arrange(Storage::SortOrder::Weight);
+        mutate(storage, 1000);
+        CHECK(done.get());
+
+        SnapshotShard   shard = openShard(path);
+        Storage         restored(64, 64);
+        CHECK(matches(shard.find(1), expected));
+        CHECK(shard.find(1).restore(restored) == Storage::Error::Success);
+        CHECK(capture(restored).size() == expected.size());
+        CHECK(matches(shard.find(1), capture(restored)));
+    }
+}
+
+int main()
+{
+    auto& catalog = ItemCatalog::shared();
+    for (uint32_t index = 0; index < Ids; index++)
+    {
+        if (index % 4 == 0) catalog.add(FirstId + index, "Capped", {}, 0.5f, {}, 1, 1, 1, 7);
+        else if (index % 17 == 0) catalog.add(FirstId + index, "Big", {}, 2.0f, {}, 2, 2, 2);
+        else catalog.add(FirstId + index, "Item", {}, 0.25f);
+    }
+
+    std::string path = (std::filesystem::temp_directory_path() / "inventory_async_save_test.snap").string();
+    {
+        AsyncSnapshotWriter writer;
+        testMutateWhileSaving(writer, path);
+        testQueuedFreezes(writer, path);
+        testArrangeWhileSaving(writer, path);
+    }
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::filesystem::remove(path + "2", error);
+
+    std::puts("async_save_test: ok");
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// Test assertion that stays on in release builds
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            std::abort();                                                                       \
+        }                                                                                       \
+    } while (0)
+
+#endif // TESTS_CHECK_H
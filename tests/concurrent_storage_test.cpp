@@ -0,0 +1,210 @@
+// Stress test for ConcurrentStorage: writer threads add, remove, split,
+// arrange and trade between two containers while reader threads scan the
+// lock-free mirror. A plain Storage is also read through its const methods
+// from several threads at once, which has to be safe with INVENTORY_STATS
+// counting. Run it in a -DINVENTORY_SANITIZE=thread build to have TSan
+// check the synchronization.
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "concurrent_storage.h"
+
+using namespace Inventory;
+
+namespace {
+    constexpr uint32_t  FirstId     = 7000;
+    constexpr uint32_t  Ids         = 24;
+    constexpr int       Writers     = 4;
+    constexpr int       Readers     = 3;
+    constexpr int       WriterOps   = 20000;
+
+    // Units of each id that the writers put in or took out, over both containers
+    std::atomic<int64_t> net[Ids];
+
+    void write(ConcurrentStorage& a, ConcurrentStorage& b, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        for (int i = 0; i < WriterOps; i++)
+        {
+            uint32_t            index   = random() % Ids;
+            uint32_t            id      = FirstId + index;
+            uint32_t            count   = 1 + random() % 3;
+            ConcurrentStorage&  mine    = random() % 2 ? a : b;
+            ConcurrentStorage&  other   = &mine == &a ? b : a;
+
+            switch (random() % 8)
+            {
+            case 0:
+            case 1:
+                if (mine.emplaceItem(id, count) == Storage::Error::Success) {
+                    net[index] += count;
+                }
+                break;
+            case 2:
+                if (mine.removeFromStack(id, count) == Storage::Error::Success) {
+                    net[index] -= count;
+                }
+                break;
+            case 3:
+                if (mine.removeItems({{id, count}}) == Storage::Error::Success) {
+                    net[index] -= count;
+                }
+                break;
+            case 4:
+            case 5:
+                ConcurrentStorage::transfer(mine, other, {{id, count}, {FirstId + (index + 1) % Ids, 1}});
+                break;
+            case 6:
+                mine.splitStack(static_cast<int>(random() % 8), static_cast<int>(random() % 8), 1);
+                break;
+            case 7:
+                if (random() % 16 == 0) {
+                    mine.arrange(Storage::SortOrder::Id);
+                }
+                break;
+            }
+        }
+    }
+
+    void read(const ConcurrentStorage& storage, const std::atomic<bool>& stop)
+    {
+        while (!stop.load(std::memory_order_acquire))
+        {
+            for (uint32_t index = 0; index < Ids; index++)
+            {
+                ItemAmount found = storage.findItemById(FirstId + index);
+                CHECK(found.count == 0 || found.id == FirstId + index);
+            }
+
+            for (int row = 0; row < storage.rows(); row++)
+            {
+                for (int col = 0; col < storage.cols(); col++)
+                {
+                    ItemAmount cell = storage.getItem(row, col);
+                    CHECK(cell.count == 0 || (cell.id >= FirstId && cell.id < FirstId + Ids));
+                }
+            }
+
+            int free = storage.freeCellCount();
+            CHECK(free >= 0 && free <= storage.rows() * storage.cols());
+            CHECK(storage.exactWeight() >= 0);
+        }
+    }
+
+    // Const methods only, nothing may be written without synchronization
+    void readShared(const Storage& storage, int seed)
+    {
+        std::mt19937 random(seed);
+        for (int i = 0; i < WriterOps; i++)
+        {
+            uint32_t    id      = FirstId + random() % Ids;
+            const Item* item    = storage.findItemById(id);
+            CHECK(item && item->id() == id && storage.countOf(id) == 1);
+            CHECK(storage.getFreeCell() < 0 || storage.isFreeCell(storage.getFreeCell() / storage.cols(), storage.getFreeCell() % storage.cols()));
+
+            if (i % 64 == 0) {
+                CHECK(storage.findByNamePrefix("Stress").size() == Ids);
+            }
+        }
+    }
+
+    // The mirror the readers see matches the storage behind the lock
+    void checkMirror(const ConcurrentStorage& storage)
+    {
+        storage.read([&storage](const Storage& locked)
+        {
+            for (uint32_t index = 0; index < Ids; index++) {
+                CHECK(storage.countOf(FirstId + index) == locked.countOf(FirstId + index));
+                CHECK(storage.findItemById(FirstId + index).count == locked.countOf(FirstId + index));
+            }
+
+            CHECK(storage.freeCellCount() == locked.freeCellCount());
+            CHECK(storage.exactWeight() == locked.exactWeight());
+            return 0;
+        });
+    }
+
+    // Totals over several stacks can pass what one stack count holds
+    void checkLargeCounts()
+    {
+        constexpr uint32_t  Id      = FirstId + Ids;
+        constexpr uint32_t  Stack   = 3000000000u;
+        ItemCatalog::shared().add(Id, "Grain", {}, 0.0f, {}, 1, 1, 0, Stack);
+
+        ConcurrentStorage storage(1, 2);
+        CHECK(storage.emplaceItem(Id, Stack) == Storage::Error::Success);
+        CHECK(storage.emplaceItem(Id, Stack) == Storage::Error::Success);
+        CHECK(storage.countOf(Id) == 2ull * Stack);
+        CHECK(storage.findItemById(Id).count == UINT32_MAX && storage.hasItem(Id));
+        checkMirror(storage);
+    }
+}
+
+int main()
+{
+    for (uint32_t index = 0; index < Ids; index++) {
+        ItemCatalog::shared().add(FirstId + index, "Stress item", {}, 0.25f * (1 + index % 4));
+    }
+
+    ConcurrentStorage a(8, 8);
+    ConcurrentStorage b(8, 8);
+    std::atomic<bool> stop {false};
+
+    std::vector<std::thread> writers;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < Readers; i++) {
+        readers.emplace_back(read, std::cref(i % 2 ? b : a), std::cref(stop));
+    }
+    for (int i = 0; i < Writers; i++) {
+        writers.emplace_back(write, std::ref(a), std::ref(b), 1234u + i);
+    }
+
+    for (auto& thread : writers) {
+        thread.join();
+    }
+    stop.store(true, std::memory_order_release);
+    for (auto& thread : readers) {
+        thread.join();
+    }
+
+    // Transfers move units but never create or lose them
+    for (uint32_t index = 0; index < Ids; index++)
+    {
+        uint32_t id = FirstId + index;
+        CHECK(static_cast<int64_t>(a.countOf(id) + b.countOf(id)) == net[index].load());
+    }
+
+    checkMirror(a);
+    checkMirror(b);
+
+    a.clear();
+    CHECK(a.freeCellCount() == 64 && a.exactWeight() == 0 && !a.hasItem(FirstId));
+
+    Storage shared(8, 8);
+    shared.setQueryIndexes(true);
+    for (uint32_t index = 0; index < Ids; index++) {
+        shared.emplaceItem(FirstId + index);
+    }
+
+    std::vector<std::thread> sharedReaders;
+    for (int i = 0; i < Readers; i++) {
+        sharedReaders.emplace_back(readShared, std::cref(shared), 99 + i);
+    }
+    for (auto& thread : sharedReaders) {
+        thread.join();
+    }
+
+#if INVENTORY_STATS
+    CHECK(shared.stats().op(StorageOp::Find).calls >= static_cast<uint64_t>(Readers) * WriterOps);
+#endif
+
+    checkLargeCounts();
+
+    std::puts("concurrent_storage_test: ok");
+    return 0;
+}
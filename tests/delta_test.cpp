@@ -0,0 +1,177 @@
+// Delta replication round trip: a replica fed encoded changesSince() deltas
+// after every batch of random changes matches the source, and deltas that
+// do not apply leave the replica untouched.
+
+#include <random>
+
+#include "check.h"
+#include "storage.h"
+
+using namespace Inventory;
+
+namespace {
+    constexpr uint32_t  FirstId     = 8000;
+    constexpr uint32_t  Ids         = 40;
+
+    struct Columns
+    {
+        std::vector<uint32_t>   ids;
+        std::vector<uint32_t>   counts;
+        int64_t                 weight;
+        uint64_t                version;
+        uint64_t                sourceVersion;
+
+        explicit Columns(const Storage& storage)
+            : ids(storage.slotIds())
+            , counts(storage.slotCounts())
+            , weight(storage.exactWeight())
+            , version(storage.version())
+            , sourceVersion(storage.sourceVersion()) {}
+
+        bool operator==(const Columns& other) const
+        {
+            return ids == other.ids && counts == other.counts && weight == other.weight &&
+                   version == other.version && sourceVersion == other.sourceVersion;
+        }
+    };
+
+    StorageDelta roundTrip(const StorageDelta& delta)
+    {
+        auto            bytes = delta.encode();
+        StorageDelta    decoded;
+        CHECK(StorageDelta::decode(bytes.data(), bytes.size(), decoded));
+        CHECK(decoded.fromVersion == delta.fromVersion && decoded.toVersion == delta.toVersion);
+        CHECK(decoded.records.size() == delta.records.size());
+        return decoded;
+    }
+
+    void mutate(Storage& storage, std::mt19937& random)
+    {
+        int changes = 1 + random() % 24;
+        for (int i = 0; i < changes; i++)
+        {
+            uint32_t id = FirstId + random() % Ids;
+            switch (random() % 8)
+            {
+            case 0:
+            case 1:
+            case 2:
+                storage.emplaceItem(id, 1 + random() % 4);
+                break;
+            case 3:
+                storage.removeFromStack(id, 1 + random() % 3);
+                break;
+            case 4:
+                storage.removeItemById(id);
+                break;
+            case 5:
+                storage.splitStack(static_cast<int>(random() % storage.rows()), static_cast<int>(random() % storage.cols()), 1);
+                break;
+            case 6:
+                if (random() % 8 == 0) {
+                    storage.arrange(random() % 2 ? Storage::SortOrder::Weight : Storage::SortOrder::Id);
+                }
+                break;
+            case 7:
+                if (random() % 40 == 0) {
+                    storage.clear();
+                }
+                break;
+            }
+        }
+    }
+
+    void testReplay()
+    {
+        Storage         source(9, 11);
+        Storage         replica(9, 11);
+        std::mt19937    random(42);
+
+        for (int round = 0; round < 500; round++)
+        {
+            mutate(source, random);
+
+            StorageDelta delta = roundTrip(source.changesSince(replica.sourceVersion()));
+            CHECK(delta.toVersion == source.version());
+            CHECK(replica.applyDelta(delta) == Storage::Error::Success);
+
+            CHECK(replica.slotIds() == source.slotIds());
+            CHECK(replica.slotCounts() == source.slotCounts());
+            CHECK(replica.exactWeight() == source.exactWeight());
+            CHECK(replica.sourceVersion() == source.version());
+            for (int cell = 0; cell < source.rows() * source.cols(); cell++) {
+                CHECK(replica.getAnchor(cell / source.cols(), cell % source.cols()) == source.getAnchor(cell / source.cols(), cell % source.cols()));
+            }
+            for (uint32_t id = FirstId; id < FirstId + Ids; id++) {
+                CHECK(replica.countOf(id) == source.countOf(id) && replica.stacksOf(id) == source.stacksOf(id));
+            }
+        }
+
+        CHECK(source.changesSince(source.version()).empty());
+    }
+
+    void testRejected()
+    {
+        Storage source(4, 4);
+        Storage replica(4, 4);
+        source.emplaceItem(FirstId, 3);
+        source.emplaceItem(FirstId + 1, 2);
+        CHECK(replica.applyDelta(source.changesSince(0)) == Storage::Error::Success);
+
+        const Columns before(replica);
+
+        // Replayed twice, or skipping a version
+        CHECK(replica.applyDelta(source.changesSince(0)) == Storage::Error::OutOfSync);
+        source.emplaceItem(FirstId + 2);
+        uint64_t missed = source.version();
+        source.emplaceItem(FirstId + 3);
+        CHECK(replica.applyDelta(source.changesSince(missed)) == Storage::Error::OutOfSync);
+        CHECK(Columns(replica) == before);
+
+        // A valid first record followed by one that cannot apply
+        StorageDelta bad = source.changesSince(replica.sourceVersion());
+        DeltaRecord overlap;
+        overlap.op      = DeltaOp::SlotSet;
+        overlap.slot    = 1;    // covered by the 2x2 stack anchored at 0
+        overlap.id      = FirstId + 5;
+        overlap.count   = 1;
+        bad.records.insert(bad.records.begin(), overlap);
+        CHECK(replica.applyDelta(bad) == Storage::Error::InvalidPosition);
+        CHECK(Columns(replica) == before);
+
+        bad = source.changesSince(replica.sourceVersion());
+        bad.records.back().op = DeltaOp::StackCount;
+        bad.records.back().slot = 15;   // empty slot
+        bad.records.back().count = 4;
+        CHECK(replica.applyDelta(bad) == Storage::Error::ItemNotFound);
+        CHECK(Columns(replica) == before);
+
+        // Truncated wire form, the output delta keeps its contents
+        auto bytes = source.changesSince(replica.sourceVersion()).encode();
+        StorageDelta kept = source.changesSince(0);
+        size_t records = kept.records.size();
+        CHECK(!StorageDelta::decode(bytes.data(), bytes.size() - 1, kept));
+        CHECK(kept.fromVersion == 0 && kept.records.size() == records);
+
+        // The intact delta still applies afterwards
+        CHECK(replica.applyDelta(roundTrip(source.changesSince(replica.sourceVersion()))) == Storage::Error::Success);
+        CHECK(replica.slotIds() == source.slotIds() && replica.slotCounts() == source.slotCounts());
+    }
+}
+
+int main()
+{
+    auto& catalog = ItemCatalog::shared();
+    for (uint32_t index = 0; index < Ids; index++)
+    {
+        uint16_t width  = index % 5 == 0 ? 2 : 1;
+        uint16_t height = index % 7 == 0 ? 2 : 1;
+        catalog.add(FirstId + index, "Delta item", {}, 0.1f * (1 + index % 9), {}, width, height, 0, index % 3 ? 6 : 0);
+    }
+
+    testReplay();
+    testRejected();
+
+    std::puts("delta_test: ok");
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Containers nested in storages: contents stay with their stack when it
+// moves and are never dropped by a removal, adds of an id whose only stack
+// is a container open a new stack, so they fail cleanly on a full grid, and
+// transfers between a bag and a storage above it only check the storages
+// whose weight changes.
+
+#include "check.h"
+#include "storage.h"
+
+using namespace Inventory;
+
+namespace {
+    constexpr uint32_t  BagId       = 9000;
+    constexpr uint32_t  RockId      = 9001;
+
+    // Adds a bag with empty contents, returns the contents
+    Storage* addBag(Storage& storage, float maxWeight = -1.0f)
+    {
+        auto        contents    = std::make_unique<Storage>(2, 2, maxWeight);
+        Storage*    nested      = contents.get();
+        auto        error       = storage.addItem(std::make_unique<Item>(ItemCatalog::shared().find(BagId)), std::move(contents));
+        return error == Storage::Error::Success ? nested : nullptr;
+    }
+
+    void testContentsFollowStacks()
+    {
+        Storage storage(3, 3, 20.0f);
+        CHECK(storage.emplaceItem(RockId, 2) == Storage::Error::Success);
+        Storage* bag = addBag(storage);
+        CHECK(bag && bag->isNested() && bag->emplaceItem(RockId, 3) == Storage::Error::Success);
+        CHECK(storage.exactWeight() == 6000 && storage.countOf(BagId) == 1);
+
+        // A bag is a stack of one that never merges or takes units
+        CHECK(storage.emplaceItem(BagId) == Storage::Error::Success);
+        CHECK(storage.stacksOf(BagId) == 2);
+        CHECK(storage.mergeStacks(0, 2, 0, 1) == Storage::Error::InvalidItem);
+        CHECK(storage.removeFromStack(BagId) == Storage::Error::InvalidItem);
+        CHECK(!storage.removeItemById(BagId));
+
+        // Arranging moves the contents with their stack
+        CHECK(storage.removeItemById(RockId));
+        CHECK(storage.arrange(Storage::SortOrder::Id) == Storage::Error::Success);
+        int slot = -1;
+        storage.forEachStack(BagId, [&](int stack) { if (storage.getContents(stack / 3, stack % 3)) slot = stack; });
+        CHECK(slot == 0 && storage.getContents(0, 0) == bag && !storage.getContents(0, 1));
+        CHECK(storage.exactWeight() == 5000);
+
+        // Removal waits until the contents are out
+        const Item* item = storage.getItem(0, 0);
+        CHECK(!storage.removeItem(item) && storage.getItem(0, 0) == item);
+        std::unique_ptr<Storage> contents = storage.takeContents(0, 0);
+        CHECK(contents.get() == bag && !bag->isNested() && storage.exactWeight() == 2000);
+        CHECK(storage.mergeStacks(0, 1, 0, 0) == Storage::Error::Success && storage.countOf(BagId) == 2);
+
+        // Contents go back onto a stack of one only
+        CHECK(storage.setContents(0, 0, std::move(contents)) == Storage::Error::InvalidItem);
+        contents = std::make_unique<Storage>(1, 1);
+        CHECK(storage.setContents(2, 2, std::move(contents)) == Storage::Error::ItemNotFound);
+        contents = std::make_unique<Storage>(1, 1);
+        CHECK(contents->emplaceItem(RockId, 30) == Storage::Error::Success);
+        CHECK(storage.removeFromStack(BagId) == Storage::Error::Success);
+        CHECK(storage.setContents(0, 0, std::move(contents)) == Storage::Error::NoSpace);
+        contents = std::make_unique<Storage>(1, 1);
+        CHECK(contents->emplaceItem(RockId, 4) == Storage::Error::Success);
+        CHECK(storage.setContents(0, 0, std::move(contents)) == Storage::Error::Success);
+        CHECK(storage.exactWeight() == 5000 && storage.getContents(0, 0)->countOf(RockId) == 4);
+
+        storage.clear();
+        CHECK(storage.exactWeight() == 0 && !storage.getContents(0, 0));
+    }
+
+    void testFullGridWithContainer()
+    {
+        Storage storage(1, 1);
+        CHECK(addBag(storage));
+        uint64_t version = storage.version();
+
+        CHECK(storage.canAddItems({{BagId, 1}}) == Storage::Error::NoSpace);
+        CHECK(storage.emplaceItem(BagId) == Storage::Error::NoSpace);
+        CHECK(storage.addItems({{BagId, 1}}) == Storage::Error::NoSpace);
+
+        Storage source(1, 1);
+        CHECK(source.emplaceItem(BagId, 3) == Storage::Error::Success);
+        CHECK(Storage::transfer(source, storage, {{BagId, 2}}) == Storage::Error::NoSpace);
+        CHECK(source.countOf(BagId) == 3);
+
+        CHECK(storage.version() == version && storage.countOf(BagId) == 1 && storage.stacksOf(BagId) == 1);
+
+        // With room left the units open a stack next to the container
+        Storage roomy(1, 2);
+        CHECK(addBag(roomy));
+        CHECK(roomy.emplaceItem(BagId, 2) == Storage::Error::Success);
+        CHECK(roomy.stacksOf(BagId) == 2 && roomy.countOf(BagId) == 3 && roomy.freeCellCount() == 0);
+    }
+
+    void testTransferAtLimit()
+    {
+        // Root at its limit: a 1.0 bag with four 1.0 rocks in it
+        Storage root(2, 2, 5.0f);
+        Storage& bag = *addBag(root);
+        CHECK(bag.emplaceItem(RockId, 4) == Storage::Error::Success);
+        CHECK(root.exactWeight() == 5000);
+
+        CHECK(Storage::transfer(bag, root, {{RockId, 1}}) == Storage::Error::Success);
+        CHECK(root.countOf(RockId) == 1 && bag.countOf(RockId) == 3 && root.exactWeight() == 5000);
+
+        CHECK(Storage::transfer(root, bag, {{RockId, 1}}) == Storage::Error::Success);
+        CHECK(root.countOf(RockId) == 0 && bag.countOf(RockId) == 4 && root.exactWeight() == 5000);
+
+        // Nothing new fits from outside, and a limited bag is still checked
+        Storage ground(1, 1);
+        CHECK(ground.emplaceItem(RockId) == Storage::Error::Success);
+        CHECK(Storage::transfer(ground, bag, {{RockId, 1}}) == Storage::Error::NoSpace);
+        CHECK(Storage::transfer(ground, root, {{RockId, 1}}) == Storage::Error::NoSpace);
+
+        Storage wide(2, 2, 10.0f);
+        Storage& small = *addBag(wide, 1.0f);
+        CHECK(wide.emplaceItem(RockId, 2) == Storage::Error::Success);
+        CHECK(Storage::transfer(wide, small, {{RockId, 1}}) == Storage::Error::Success);
+        CHECK(Storage::transfer(wide, small, {{RockId, 1}}) == Storage::Error::NoSpace);
+        CHECK(wide.countOf(RockId) == 1 && small.countOf(RockId) == 1 && wide.exactWeight() == 3000);
+
+        // Between two bags of the same storage, the storage keeps its total
+        CHECK(Storage::transfer(bag, root, {{RockId, 1}}) == Storage::Error::Success);
+        CHECK(root.removeFromStack(RockId) == Storage::Error::Success);
+        Storage& other = *addBag(root);
+        CHECK(root.exactWeight() == 5000);
+        CHECK(Storage::transfer(bag, other, {{RockId, 2}}) == Storage::Error::Success);
+        CHECK(bag.countOf(RockId) == 1 && other.countOf(RockId) == 2 && root.exactWeight() == 5000);
+    }
+}
+
+int main()
+{
+    auto& catalog = ItemCatalog::shared();
+    catalog.add(BagId, "Bag", {}, 1.0f, {}, 1, 1, 0, 0);
+    catalog.add(RockId, "Rock", {}, 1.0f, {}, 1, 1, 0, 0);
+
+    testContentsFollowStacks();
+    testFullGridWithContainer();
+    testTransferAtLimit();
+
+    std::puts("nested_storage_test: ok");
+    return 0;
+}
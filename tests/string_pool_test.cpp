@@ -0,0 +1,54 @@
+// StringPool: interned views keep their text, whatever order small and
+// oversized strings come in, and after clear().
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "string_pool.h"
+
+using namespace Inventory;
+
+namespace {
+    void testOversizedFirst()
+    {
+        StringPool pool(1024);
+        for (int round = 0; round < 2; round++)
+        {
+            std::string         big(20000, 'x');
+            std::string_view    bigView     = pool.intern(big);
+            std::string_view    hello       = pool.intern("hello");
+
+            CHECK(bigView == big && hello == "hello");
+            CHECK(bigView.data()[big.size()] == '\0' && hello.data()[5] == '\0');
+            CHECK(pool.intern(big).data() == bigView.data());
+            pool.clear();
+        }
+    }
+
+    void testMixed()
+    {
+        StringPool                      pool(256);
+        std::vector<std::string>        texts;
+        std::vector<std::string_view>   views;
+        for (int i = 0; i < 500; i++)
+        {
+            texts.push_back(std::string(i % 7 == 0 ? 100 + i : 1 + i % 30, static_cast<char>('a' + i % 26)) + std::to_string(i));
+            views.push_back(pool.intern(texts.back()));
+        }
+
+        for (size_t i = 0; i < texts.size(); i++) {
+            CHECK(views[i] == texts[i] && pool.intern(texts[i]).data() == views[i].data());
+        }
+        CHECK(pool.size() == texts.size());
+    }
+}
+
+int main()
+{
+    testOversizedFirst();
+    testMixed();
+
+    std::puts("string_pool_test: ok");
+    return 0;
+}